@@ -0,0 +1,502 @@
+// GUI stress benchmark, builds up to tens of thousands of GUI elements in a hidden window, feeds them synthetic
+// SDL input and times dispatch and rendering. Results are written as JSON so that runs can be compared.
+//
+// Usage: gui_benchmark [--elements N] [--frames N] [--events N] [--seed N] [--out path]
+// Must be run with res/fonts in the working directory, like the playground itself.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+
+#include <SDL2/SDL.h>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../json.h"
+#include "../gui.h"
+#include "../shaders.h"
+#include "../input_state.h"
+#include "../run_report.h"
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct BenchOptions
+    {
+        int elementCount = 1000;
+        int frameCount = 200;
+        int eventCount = 2000; // Number of scripted interactions, each made up of several SDL events
+        unsigned int seed = 1;
+        std::string outPath = "gui_benchmark.json";
+    };
+
+    // One movable panel with a nested panel, a button with a label and sometimes an edit text
+    struct BenchGroup
+    {
+        gui::GUIElement* panel = nullptr;
+        gui::GUIButton* button = nullptr;
+        gui::GUIEditText* editText = nullptr;
+    };
+
+    // Durations in microseconds
+    struct Samples
+    {
+        std::vector<double> values;
+
+        void add(Clock::duration duration)
+        {
+            values.emplace_back(std::chrono::duration<double, std::micro>(duration).count());
+        }
+
+        nlohmann::json summary() const
+        {
+            nlohmann::json j;
+            j["count"] = values.size();
+            if (values.empty())
+            {
+                return j;
+            }
+
+            std::vector<double> sorted = values;
+            std::sort(sorted.begin(), sorted.end());
+            double total = 0.0;
+            for (double v : sorted)
+            {
+                total += v;
+            }
+
+            j["mean_us"] = total / sorted.size();
+            j["p50_us"] = sorted[sorted.size() / 2];
+            j["p99_us"] = sorted[std::min(sorted.size() - 1, sorted.size() * 99 / 100)];
+            j["max_us"] = sorted.back();
+            return j;
+        }
+    };
+
+    bool parseOptions(int argc, char* args[], BenchOptions* options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = args[i];
+            if (i + 1 >= argc)
+            {
+                std::cerr << "Missing value for " << arg << std::endl;
+                return false;
+            }
+
+            std::string value = args[++i];
+            if (arg == "--elements")
+            {
+                options->elementCount = std::max(1, std::stoi(value));
+            }
+            else if (arg == "--frames")
+            {
+                options->frameCount = std::max(1, std::stoi(value));
+            }
+            else if (arg == "--events")
+            {
+                options->eventCount = std::max(0, std::stoi(value));
+            }
+            else if (arg == "--seed")
+            {
+                options->seed = (unsigned int)std::stoul(value);
+            }
+            else if (arg == "--out")
+            {
+                options->outPath = value;
+            }
+            else
+            {
+                std::cerr << "Unknown argument " << arg << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Drivers hand out names in increasing order, so every live object has a name below the next free one
+    int countNames(GLuint nextFreeName, const std::function<bool(GLuint)>& isName)
+    {
+        int count = 0;
+        for (GLuint name = 1; name < nextFreeName; ++name)
+        {
+            if (isName(name))
+            {
+                ++count;
+            }
+        }
+        return count;
+    }
+
+    nlohmann::json countGLObjects()
+    {
+        GLuint nextBuffer, nextVertexArray, nextTexture, nextFramebuffer;
+        glGenBuffers(1, &nextBuffer);
+        glGenVertexArrays(1, &nextVertexArray);
+        glGenTextures(1, &nextTexture);
+        glGenFramebuffers(1, &nextFramebuffer);
+        GLuint nextProgram = glCreateProgram(); // Shares its namespace with shaders, which are deleted after linking
+
+        nlohmann::json j;
+        j["buffers"] = countNames(nextBuffer, [](GLuint name) { return glIsBuffer(name) == GL_TRUE; });
+        j["vertex_arrays"] = countNames(nextVertexArray, [](GLuint name) { return glIsVertexArray(name) == GL_TRUE; });
+        j["textures"] = countNames(nextTexture, [](GLuint name) { return glIsTexture(name) == GL_TRUE; });
+        j["framebuffers"] = countNames(nextFramebuffer, [](GLuint name) { return glIsFramebuffer(name) == GL_TRUE; });
+        j["programs"] = countNames(nextProgram, [](GLuint name) { return glIsProgram(name) == GL_TRUE; });
+
+        glDeleteBuffers(1, &nextBuffer);
+        glDeleteVertexArrays(1, &nextVertexArray);
+        glDeleteTextures(1, &nextTexture);
+        glDeleteFramebuffers(1, &nextFramebuffer);
+        glDeleteProgram(nextProgram);
+
+        return j;
+    }
+
+    bool initializeContext(int width, int height, SDL_Window** window, SDL_GLContext* context)
+    {
+        if (SDL_Init(SDL_INIT_VIDEO) < 0)
+        {
+            std::cerr << "Failed to initialize SDL: " << SDL_GetError() << std::endl;
+            return false;
+        }
+
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 4);
+
+        // Never shown, the GUI renders into its offscreen texture regardless
+        *window = SDL_CreateWindow("GUI benchmark", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, width, height, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+        if (*window == nullptr)
+        {
+            std::cerr << "Failed to create window: " << SDL_GetError() << std::endl;
+            return false;
+        }
+
+        *context = SDL_GL_CreateContext(*window);
+        if (*context == nullptr)
+        {
+            std::cerr << "Failed to create OpenGL context: " << SDL_GetError() << std::endl;
+            return false;
+        }
+
+        if (!gladLoadGLLoader((GLADloadproc)SDL_GL_GetProcAddress))
+        {
+            std::cerr << "Failed to initialize GLAD" << std::endl;
+            return false;
+        }
+
+        SDL_GL_SetSwapInterval(0);
+        glViewport(0, 0, width, height);
+        return true;
+    }
+
+    std::vector<BenchGroup> buildGUI(gui::GUIHandler* handler, int elementCount, text::Font* font, int* clickCount)
+    {
+        const int panelWidth = 120, panelHeight = 60, spacing = 10;
+        int columns = std::max(1, (int)handler->getWindowWidth() / (panelWidth + spacing));
+        int rows = std::max(1, (int)handler->getWindowHeight() / (panelHeight + spacing));
+
+        std::vector<BenchGroup> groups;
+        int built = 0;
+        while (built < elementCount)
+        {
+            int ix = (int)groups.size();
+            // Groups beyond one screenful are stacked on top of the earlier ones
+            int x = spacing + (ix % columns) * (panelWidth + spacing);
+            int y = spacing + ((ix / columns) % rows) * (panelHeight + spacing);
+
+            BenchGroup group;
+            group.panel = gui::GUIElementBuilder().setHandler(handler).setPosition(x, y).setSize(panelWidth, panelHeight).buildElement();
+            auto inner = gui::GUIElementBuilder().setHandler(handler).setPosition(5, 5).setSize(70, 50).setFlags(false, false, true, true).setColor(gui::colorMap.at("GRAY")).buildElement();
+            group.button = gui::GUIElementBuilder().setHandler(handler).setPosition(5, 5).setSize(60, 40).setFlags(false, false, true, true).setColor(gui::colorMap.at("BLUE"))
+                .setOnClick([clickCount](gui::GUIButton*) { ++*clickCount; }).buildButton();
+            auto label = gui::GUIElementBuilder().setHandler(handler).setPosition(0, 0).setSize(60, 40).setFlags(false, false, true, false).setColor(gui::colorMap.at("WHITE"))
+                .setText(L"BUTTON " + std::to_wstring(ix)).setFont(font).buildText();
+            if (group.panel == nullptr || inner == nullptr || group.button == nullptr || label == nullptr)
+            {
+                std::cerr << "Failed to build benchmark elements" << std::endl;
+                break;
+            }
+
+            group.panel->addChild(inner);
+            inner->addChild(group.button);
+            group.button->addChild(label);
+            built += 4;
+
+            if (ix % 4 == 0 && built < elementCount)
+            {
+                group.editText = gui::GUIElementBuilder().setHandler(handler).setPosition(80, 5).setSize(35, 50).setFlags(false, false, true, false).setColor(gui::colorMap.at("BLACK"))
+                    .setText(L"EDIT").setFont(font).buildEditText();
+                if (group.editText != nullptr)
+                {
+                    group.panel->addChild(group.editText);
+                    built += 1;
+                }
+            }
+
+            groups.emplace_back(group);
+        }
+
+        return groups;
+    }
+
+    /*
+        SYNTHETIC INPUT, positions are in the GUI's bottom-left system and converted to SDL's top-left system
+     */
+    SDL_Event makeButtonEvent(Uint32 type, int x, int y, int windowHeight)
+    {
+        SDL_Event event = {};
+        event.type = type;
+        event.button.button = SDL_BUTTON_LEFT;
+        event.button.state = type == SDL_MOUSEBUTTONDOWN ? SDL_PRESSED : SDL_RELEASED;
+        event.button.x = x;
+        event.button.y = windowHeight - y;
+        return event;
+    }
+
+    SDL_Event makeMotionEvent(int x, int y, int xrel, int yrel, int windowHeight)
+    {
+        SDL_Event event = {};
+        event.type = SDL_MOUSEMOTION;
+        event.motion.state = SDL_BUTTON_LMASK;
+        event.motion.x = x;
+        event.motion.y = windowHeight - y;
+        event.motion.xrel = xrel;
+        event.motion.yrel = yrel;
+        return event;
+    }
+
+    SDL_Event makeTextEvent(const char* text)
+    {
+        SDL_Event event = {};
+        event.type = SDL_TEXTINPUT;
+        SDL_strlcpy(event.text.text, text, sizeof(event.text.text));
+        return event;
+    }
+
+    SDL_Event makeKeyEvent(SDL_Keycode key)
+    {
+        SDL_Event event = {};
+        event.type = SDL_KEYDOWN;
+        event.key.state = SDL_PRESSED;
+        event.key.keysym.sym = key;
+        return event;
+    }
+}
+
+int main(int argc, char* args[])
+{
+    BenchOptions options;
+    if (!parseOptions(argc, args, &options))
+    {
+        return -1;
+    }
+
+    const int windowWidth = 1280, windowHeight = 720;
+    SDL_Window* window = nullptr;
+    SDL_GLContext context = nullptr;
+    if (!initializeContext(windowWidth, windowHeight, &window, &context))
+    {
+        return -1;
+    }
+
+    nlohmann::json results;
+    results["options"] = { {"elements", options.elementCount}, {"frames", options.frameCount}, {"events", options.eventCount}, {"seed", options.seed} };
+    results["window"] = { {"width", windowWidth}, {"height", windowHeight} };
+    results["gl_objects_before_build"] = countGLObjects();
+    size_t memoryBefore = getResidentMemoryBytes();
+
+    // The GUI shaders read their projection from the per-frame constants
+    GLuint frameConstantsUBO = shaders::createFrameConstantsBuffer();
+    shaders::FrameConstants frameConstants = {};
+    frameConstants.ortho = glm::ortho(0.0f, (float)windowWidth, 0.0f, (float)windowHeight);
+    frameConstants.viewport = glm::vec4(0.0f, 0.0f, (float)windowWidth, (float)windowHeight);
+    shaders::updateFrameConstants(frameConstantsUBO, frameConstants);
+
+    auto buildStart = Clock::now();
+    gui::GUIHandler* handler = new gui::GUIHandler((float)windowWidth, (float)windowHeight);
+    text::Font* font = new text::Font("NotoSans", "res/fonts/NotoSans");
+    int clickCount = 0;
+    std::vector<BenchGroup> groups = buildGUI(handler, options.elementCount, font, &clickCount);
+    glFinish();
+    results["build_ms"] = std::chrono::duration<double, std::milli>(Clock::now() - buildStart).count();
+    results["root_elements"] = handler->getRootElementCount();
+    if (groups.empty())
+    {
+        std::cerr << "No elements built, aborting benchmark" << std::endl;
+        return -1;
+    }
+
+    /*
+        INPUT DISPATCH
+     */
+    InputState inputState;
+    Samples clickSamples, dragSamples, resizeSamples, textSamples, allSamples;
+    std::mt19937 rng(options.seed);
+    const gui::GUILayoutPool& layout = handler->getLayout();
+
+    auto dispatch = [&](const SDL_Event& event, Samples& samples)
+    {
+        auto start = Clock::now();
+        handler->receiveInputAllElements(&event, &inputState);
+        auto duration = Clock::now() - start;
+        samples.add(duration);
+        allSamples.add(duration);
+    };
+
+    std::vector<size_t> editGroups;
+    for (size_t i = 0; i < groups.size(); ++i)
+    {
+        if (groups[i].editText != nullptr)
+        {
+            editGroups.emplace_back(i);
+        }
+    }
+
+    for (int i = 0; i < options.eventCount; ++i)
+    {
+        const BenchGroup& group = groups[rng() % groups.size()];
+        uint32_t panelSlot = group.panel->getHandle().index;
+        int x = layout.xPos[panelSlot], y = layout.yPos[panelSlot];
+        int width = layout.width[panelSlot], height = layout.height[panelSlot];
+
+        switch (i % 4)
+        {
+        case 0: // Click on the button
+        {
+            uint32_t buttonSlot = group.button->getHandle().index;
+            int buttonX = layout.xPos[buttonSlot] + layout.width[buttonSlot] / 2;
+            int buttonY = layout.yPos[buttonSlot] + layout.height[buttonSlot] / 2;
+            dispatch(makeButtonEvent(SDL_MOUSEBUTTONDOWN, buttonX, buttonY, windowHeight), clickSamples);
+            dispatch(makeButtonEvent(SDL_MOUSEBUTTONUP, buttonX, buttonY, windowHeight), clickSamples);
+            break;
+        }
+
+        case 1: // Drag the panel by the gap between its children
+        {
+            int grabX = x + 77, grabY = y + height / 2;
+            dispatch(makeButtonEvent(SDL_MOUSEBUTTONDOWN, grabX, grabY, windowHeight), dragSamples);
+            int dx = (int)(rng() % 7) - 3, dy = (int)(rng() % 7) - 3;
+            for (int step = 0; step < 8; ++step)
+            {
+                grabX += dx, grabY -= dy;
+                dispatch(makeMotionEvent(grabX, grabY, dx, dy, windowHeight), dragSamples);
+            }
+            dispatch(makeButtonEvent(SDL_MOUSEBUTTONUP, grabX, grabY, windowHeight), dragSamples);
+            break;
+        }
+
+        case 2: // Resize the panel from its top right corner, growing then shrinking back
+        {
+            int cornerX = x + width, cornerY = y + height;
+            dispatch(makeButtonEvent(SDL_MOUSEBUTTONDOWN, cornerX, cornerY, windowHeight), resizeSamples);
+            for (int step = 0; step < 8; ++step)
+            {
+                int delta = step < 4 ? 2 : -2;
+                cornerX += delta, cornerY += delta;
+                dispatch(makeMotionEvent(cornerX, cornerY, delta, -delta, windowHeight), resizeSamples);
+            }
+            dispatch(makeButtonEvent(SDL_MOUSEBUTTONUP, cornerX, cornerY, windowHeight), resizeSamples);
+            break;
+        }
+
+        case 3: // Type into an edit text, keyboard events are offered to every root
+        {
+            if (editGroups.empty())
+            {
+                break;
+            }
+
+            gui::GUIEditText* editText = groups[editGroups[rng() % editGroups.size()]].editText;
+            uint32_t editSlot = editText->getHandle().index;
+            int editX = layout.xPos[editSlot] + layout.width[editSlot] / 2;
+            int editY = layout.yPos[editSlot] + layout.height[editSlot] / 2;
+            dispatch(makeButtonEvent(SDL_MOUSEBUTTONDOWN, editX, editY, windowHeight), textSamples);
+            dispatch(makeButtonEvent(SDL_MOUSEBUTTONUP, editX, editY, windowHeight), textSamples);
+            for (int step = 0; step < 4; ++step)
+            {
+                dispatch(makeTextEvent("a"), textSamples);
+            }
+            for (int step = 0; step < 4; ++step)
+            {
+                dispatch(makeKeyEvent(SDLK_BACKSPACE), textSamples);
+            }
+            dispatch(makeKeyEvent(SDLK_ESCAPE), textSamples);
+            break;
+        }
+        }
+    }
+
+    results["dispatch"] = {
+        {"click", clickSamples.summary()},
+        {"drag", dragSamples.summary()},
+        {"resize", resizeSamples.summary()},
+        {"text", textSamples.summary()},
+        {"all", allSamples.summary()}
+    };
+    results["button_clicks"] = clickCount;
+
+    /*
+        RENDERING, glFinish so that the GPU work is part of the measured time
+     */
+    Samples fullFrameSamples, cachedFrameSamples;
+    for (int frame = 0; frame < options.frameCount; ++frame)
+    {
+        frameConstants.time = (float)SDL_GetTicks() / 1000.0f;
+        shaders::updateFrameConstants(frameConstantsUBO, frameConstants);
+
+        // Alternate between redrawing everything and only compositing the cached GUI
+        bool fullRedraw = frame % 2 == 0;
+        if (fullRedraw)
+        {
+            handler->markDirty(0, 0, windowWidth, windowHeight);
+        }
+
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        auto start = Clock::now();
+        handler->renderAllElements();
+        glFinish();
+        (fullRedraw ? fullFrameSamples : cachedFrameSamples).add(Clock::now() - start);
+    }
+
+    results["frame"] = {
+        {"full_redraw", fullFrameSamples.summary()},
+        {"cached", cachedFrameSamples.summary()}
+    };
+    results["gl_objects"] = countGLObjects();
+
+    size_t memoryAfter = getResidentMemoryBytes();
+    results["memory_bytes"] = { {"before_build", memoryBefore}, {"after_run", memoryAfter}, {"gui", memoryAfter > memoryBefore ? memoryAfter - memoryBefore : 0} };
+
+    GLenum error = glGetError();
+    results["gl_error"] = error;
+
+    std::ofstream outFile(options.outPath);
+    if (!outFile)
+    {
+        std::cerr << "Failed to open " << options.outPath << " for writing" << std::endl;
+        return -1;
+    }
+    outFile << results.dump(4) << std::endl;
+    std::cout << "Benchmark results written to " << options.outPath << std::endl;
+
+    delete handler;
+    glDeleteBuffers(1, &frameConstantsUBO);
+    SDL_GL_DeleteContext(context);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+
+    return 0;
+}
@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "camera_path.h"
+
+namespace
+{
+    // Catmull-Rom tangent at keyframe i, the neighbours' difference over their time difference so unevenly
+    // spaced keyframes still give a smooth speed, one-sided at the ends of the path
+    template<typename T>
+    T getTangent(const std::vector<CameraKeyframe>& keyframes, size_t i, T CameraKeyframe::*value)
+    {
+        size_t previous = i > 0 ? i - 1 : i;
+        size_t next = i + 1 < keyframes.size() ? i + 1 : i;
+        double dt = keyframes[next].time - keyframes[previous].time;
+        if (dt <= 0.0)
+        {
+            return T(0.0f);
+        }
+        return (keyframes[next].*value - keyframes[previous].*value) * (float)(1.0 / dt);
+    }
+
+    // Cubic Hermite interpolation between keyframes i and i + 1, s in [0, 1]
+    template<typename T>
+    T interpolate(const std::vector<CameraKeyframe>& keyframes, size_t i, float s, T CameraKeyframe::*value)
+    {
+        float dt = (float)(keyframes[i + 1].time - keyframes[i].time);
+        float s2 = s * s, s3 = s2 * s;
+        return keyframes[i].*value * (2.0f * s3 - 3.0f * s2 + 1.0f)
+            + getTangent(keyframes, i, value) * (dt * (s3 - 2.0f * s2 + s))
+            + keyframes[i + 1].*value * (-2.0f * s3 + 3.0f * s2)
+            + getTangent(keyframes, i + 1, value) * (dt * (s3 - s2));
+    }
+}
+
+bool CameraPath::load(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        std::cerr << "Failed to open camera path " << path << std::endl;
+        return false;
+    }
+
+    keyframes.clear();
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        ++lineNumber;
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+
+        CameraKeyframe keyframe;
+        std::istringstream stream(line);
+        if (!(stream >> keyframe.time >> keyframe.position.x >> keyframe.position.y >> keyframe.position.z
+            >> keyframe.yaw >> keyframe.pitch >> keyframe.speed))
+        {
+            std::cerr << "Invalid keyframe on line " << lineNumber << " of " << path << std::endl;
+            return false;
+        }
+        if (!keyframes.empty() && keyframe.time < keyframes.back().time)
+        {
+            std::cerr << "Keyframe on line " << lineNumber << " of " << path << " goes back in time" << std::endl;
+            return false;
+        }
+        keyframes.emplace_back(keyframe);
+    }
+
+    if (keyframes.empty())
+    {
+        std::cerr << "Camera path " << path << " has no keyframes" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool CameraPath::save(const std::string& path) const
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        std::cerr << "Failed to open " << path << " for writing" << std::endl;
+        return false;
+    }
+
+    file << "# time x y z yaw pitch speed" << std::endl;
+    file.precision(9);
+    for (const CameraKeyframe& keyframe : keyframes)
+    {
+        file << keyframe.time << " " << keyframe.position.x << " " << keyframe.position.y << " " << keyframe.position.z
+            << " " << keyframe.yaw << " " << keyframe.pitch << " " << keyframe.speed << std::endl;
+    }
+    return true;
+}
+
+void CameraPath::addKeyframe(const CameraKeyframe& keyframe)
+{
+    keyframes.emplace_back(keyframe);
+
+    // Within pi of the previous yaw, so the spline turns the short way round instead of spinning at the wrap
+    if (keyframes.size() > 1)
+    {
+        const float TWO_PI = 6.28318531f;
+        float& yaw = keyframes.back().yaw;
+        yaw += TWO_PI * std::round((keyframes[keyframes.size() - 2].yaw - yaw) / TWO_PI);
+    }
+}
+
+CameraKeyframe CameraPath::evaluate(double time) const
+{
+    if (time <= keyframes.front().time)
+    {
+        return keyframes.front();
+    }
+    if (time >= keyframes.back().time)
+    {
+        return keyframes.back();
+    }
+
+    // First keyframe after time, the segment starts at the one before it
+    auto next = std::upper_bound(keyframes.begin(), keyframes.end(), time, [](double t, const CameraKeyframe& keyframe) { return t < keyframe.time; });
+    size_t i = (size_t)(next - keyframes.begin()) - 1;
+    float s = (float)((time - keyframes[i].time) / (keyframes[i + 1].time - keyframes[i].time));
+
+    CameraKeyframe result;
+    result.time = time;
+    result.position = interpolate(keyframes, i, s, &CameraKeyframe::position);
+    result.yaw = interpolate(keyframes, i, s, &CameraKeyframe::yaw);
+    result.pitch = interpolate(keyframes, i, s, &CameraKeyframe::pitch);
+    result.speed = interpolate(keyframes, i, s, &CameraKeyframe::speed);
+    return result;
+}
+
+double CameraPath::getDuration() const
+{
+    return keyframes.empty() ? 0.0 : keyframes.back().time;
+}
+
+size_t CameraPath::getKeyframeCount() const
+{
+    return keyframes.size();
+}
+
+bool CameraPath::isEmpty() const
+{
+    return keyframes.empty();
+}
+
+glm::vec3 getLookDirection(float yaw, float pitch)
+{
+    glm::vec3 lookDir;
+    lookDir.x = std::cos(yaw) * std::cos(pitch);
+    lookDir.y = std::sin(pitch);
+    lookDir.z = std::sin(yaw) * std::cos(pitch);
+    return glm::normalize(lookDir);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+// Camera state at a point in time along a path, yaw and pitch in radians like Camera
+struct CameraKeyframe
+{
+    double time; // Seconds since the start of playback
+    glm::vec3 position;
+    float yaw;
+    float pitch;
+    float speed;
+};
+
+// Keyframes recorded from the camera, played back with Catmull-Rom splines so flythroughs along the same path can
+// be compared across runs. Stored as text, one "time x y z yaw pitch speed" line per keyframe, so paths can be edited
+class CameraPath
+{
+public:
+    bool load(const std::string& path);
+    bool save(const std::string& path) const;
+
+    // Keyframes must be added in order of time, yaw is unwrapped to within pi of the previous keyframe's
+    void addKeyframe(const CameraKeyframe& keyframe);
+    // Clamped to the first and last keyframe outside the path, must not be called on an empty path
+    CameraKeyframe evaluate(double time) const;
+
+    // Time of the last keyframe
+    double getDuration() const;
+    size_t getKeyframeCount() const;
+    bool isEmpty() const;
+
+private:
+    std::vector<CameraKeyframe> keyframes;
+};
+
+// Look direction of a camera with the given yaw and pitch, as used by Renderer::onYawPitch
+glm::vec3 getLookDirection(float yaw, float pitch);
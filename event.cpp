@@ -2,41 +2,131 @@
 
 namespace event
 {
+    Event::Event(EventType type) : type(type) {}
+
     Event::~Event() {}
 
-    WindowResizeEvent::WindowResizeEvent(int newWidth, int newHeight) : newWidth(newWidth), newHeight(newHeight) {}
+    WindowResizeEvent::WindowResizeEvent(int newWidth, int newHeight) : Event(TYPE), newWidth(newWidth), newHeight(newHeight) {}
 
     WindowResizeEvent::~WindowResizeEvent() {}
 
-    QuitEvent::QuitEvent() {}
+    QuitEvent::QuitEvent() : Event(TYPE) {}
 
     QuitEvent::~QuitEvent() {}
 
-    NextModelEvent::NextModelEvent() {}
+    NextModelEvent::NextModelEvent() : Event(TYPE) {}
 
     NextModelEvent::~NextModelEvent() {}
 
-    NextCubemapEvent::NextCubemapEvent() {}
+    NextCubemapEvent::NextCubemapEvent() : Event(TYPE) {}
 
     NextCubemapEvent::~NextCubemapEvent() {}
 
-    LightAzimuthChangeEvent::LightAzimuthChangeEvent(float delta) : delta(delta) {}
+    LightAzimuthChangeEvent::LightAzimuthChangeEvent(float delta) : Event(TYPE), delta(delta) {}
 
     LightAzimuthChangeEvent::~LightAzimuthChangeEvent() {}
 
-    LightInclineChangeEvent::LightInclineChangeEvent(float delta) : delta(delta) {}
+    LightInclineChangeEvent::LightInclineChangeEvent(float delta) : Event(TYPE), delta(delta) {}
 
     LightInclineChangeEvent::~LightInclineChangeEvent() {}
 
-    LuminanceChangeEvent::LuminanceChangeEvent(float delta) : delta(delta) {}
+    LuminanceChangeEvent::LuminanceChangeEvent(float delta) : Event(TYPE), delta(delta) {}
 
     LuminanceChangeEvent::~LuminanceChangeEvent() {}
 
-    ScaleChangeEvent::ScaleChangeEvent(float delta) : delta(delta) {}
+    ScaleChangeEvent::ScaleChangeEvent(float delta) : Event(TYPE), delta(delta) {}
 
     ScaleChangeEvent::~ScaleChangeEvent() {}
 
-    CameraSpeedChangeEvent::CameraSpeedChangeEvent(float factor) : factor(factor) {}
+    CameraSpeedChangeEvent::CameraSpeedChangeEvent(float factor) : Event(TYPE), factor(factor) {}
 
     CameraSpeedChangeEvent::~CameraSpeedChangeEvent() {}
-}
\ No newline at end of file
+
+    EventRecord EventRecord::copyOf(const Event& event)
+    {
+        switch (event.getType())
+        {
+        case EventType::WindowResize:       return EventRecord(static_cast<const WindowResizeEvent&>(event));
+        case EventType::Quit:               return EventRecord(static_cast<const QuitEvent&>(event));
+        case EventType::NextModel:          return EventRecord(static_cast<const NextModelEvent&>(event));
+        case EventType::NextCubemap:        return EventRecord(static_cast<const NextCubemapEvent&>(event));
+        case EventType::LightAzimuthChange: return EventRecord(static_cast<const LightAzimuthChangeEvent&>(event));
+        case EventType::LightInclineChange: return EventRecord(static_cast<const LightInclineChangeEvent&>(event));
+        case EventType::LuminanceChange:    return EventRecord(static_cast<const LuminanceChangeEvent&>(event));
+        case EventType::ScaleChange:        return EventRecord(static_cast<const ScaleChangeEvent&>(event));
+        case EventType::CameraSpeedChange:  return EventRecord(static_cast<const CameraSpeedChangeEvent&>(event));
+        default:                            return EventRecord();
+        }
+    }
+
+    namespace
+    {
+        template<typename T>
+        void addDelta(EventRecord& record, const Event& event)
+        {
+            record.getIf<T>()->delta += static_cast<const T&>(event).delta;
+        }
+    }
+
+    void EventCoalescer::add(const Event& event)
+    {
+        EventRecord& record = pending[(size_t)event.getType()];
+        if (record.isEmpty())
+        {
+            record = EventRecord::copyOf(event);
+            return;
+        }
+
+        switch (event.getType())
+        {
+        case EventType::LightAzimuthChange:
+            addDelta<LightAzimuthChangeEvent>(record, event);
+            break;
+        case EventType::LightInclineChange:
+            addDelta<LightInclineChangeEvent>(record, event);
+            break;
+        case EventType::LuminanceChange:
+            addDelta<LuminanceChangeEvent>(record, event);
+            break;
+        case EventType::ScaleChange:
+            addDelta<ScaleChangeEvent>(record, event);
+            break;
+        case EventType::CameraSpeedChange:
+            record.getIf<CameraSpeedChangeEvent>()->factor *= static_cast<const CameraSpeedChangeEvent&>(event).factor;
+            break;
+        default:
+            record = EventRecord::copyOf(event); // E.g. repeated NextModelEvents collapse into one
+            break;
+        }
+    }
+
+    bool EventCoalescer::take(EventType type, EventRecord& record)
+    {
+        EventRecord& pendingRecord = pending[(size_t)type];
+        if (pendingRecord.isEmpty())
+        {
+            return false;
+        }
+
+        record = pendingRecord;
+        pendingRecord = EventRecord();
+        return true;
+    }
+
+    bool EventCoalescer::isPending(EventType type) const
+    {
+        return !pending[(size_t)type].isEmpty();
+    }
+
+    bool EventCoalescer::isEmpty() const
+    {
+        for (const EventRecord& record : pending)
+        {
+            if (!record.isEmpty())
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+}
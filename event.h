@@ -1,16 +1,46 @@
 #pragma once
 
+#include <array>
+#include <functional>
+#include <variant>
+
 namespace event
 {
+    // Compile-time id of every concrete event, used to index dispatch tables
+    // instead of testing an event against each class with dynamic_cast
+    enum class EventType
+    {
+        WindowResize,
+        Quit,
+        NextModel,
+        NextCubemap,
+        LightAzimuthChange,
+        LightInclineChange,
+        LuminanceChange,
+        ScaleChange,
+        CameraSpeedChange,
+        Count
+    };
+
     class Event
     {
     public:
         virtual ~Event();
+
+        EventType getType() const { return type; }
+
+    protected:
+        Event(EventType type);
+
+    private:
+        EventType type;
     };
 
     class WindowResizeEvent : public Event
     {
     public:
+        static constexpr EventType TYPE = EventType::WindowResize;
+
         WindowResizeEvent(int newWidth, int newHeight);
         ~WindowResizeEvent();
 
@@ -21,6 +51,8 @@ namespace event
     class QuitEvent : public Event
     {
     public:
+        static constexpr EventType TYPE = EventType::Quit;
+
         QuitEvent();
         ~QuitEvent();
     };
@@ -28,6 +60,8 @@ namespace event
     class NextModelEvent : public Event
     {
     public:
+        static constexpr EventType TYPE = EventType::NextModel;
+
         NextModelEvent();
         ~NextModelEvent();
     };  
@@ -35,6 +69,8 @@ namespace event
     class NextCubemapEvent : public Event
     {
     public:
+        static constexpr EventType TYPE = EventType::NextCubemap;
+
         NextCubemapEvent();
         ~NextCubemapEvent();
     };
@@ -42,6 +78,8 @@ namespace event
     class LightAzimuthChangeEvent : public Event
     {
     public:
+        static constexpr EventType TYPE = EventType::LightAzimuthChange;
+
         LightAzimuthChangeEvent(float delta);
         ~LightAzimuthChangeEvent();
 
@@ -51,6 +89,8 @@ namespace event
     class LightInclineChangeEvent : public Event
     {
     public:
+        static constexpr EventType TYPE = EventType::LightInclineChange;
+
         LightInclineChangeEvent(float delta);
         ~LightInclineChangeEvent();
 
@@ -60,6 +100,8 @@ namespace event
     class LuminanceChangeEvent : public Event
     {
     public:
+        static constexpr EventType TYPE = EventType::LuminanceChange;
+
         LuminanceChangeEvent(float delta);
         ~LuminanceChangeEvent();
 
@@ -69,6 +111,8 @@ namespace event
     class ScaleChangeEvent : public Event
     {
     public:
+        static constexpr EventType TYPE = EventType::ScaleChange;
+
         ScaleChangeEvent(float delta);
         ~ScaleChangeEvent();
 
@@ -78,9 +122,114 @@ namespace event
     class CameraSpeedChangeEvent : public Event
     {
     public:
+        static constexpr EventType TYPE = EventType::CameraSpeedChange;
+
         CameraSpeedChangeEvent(float factor);
         ~CameraSpeedChangeEvent();
 
         float factor;
     };
-}
\ No newline at end of file
+
+    // Fixed-size copy of any concrete event, for storing events by value (e.g. in queues) without a heap allocation
+    class EventRecord
+    {
+    public:
+        EventRecord() = default;
+
+        template<typename T>
+        EventRecord(const T& event) : storage(event) {}
+
+        // Copies event by its dynamic type
+        static EventRecord copyOf(const Event& event);
+
+        bool isEmpty() const
+        {
+            return std::holds_alternative<std::monostate>(storage);
+        }
+
+        // Returns nullptr if the record does not hold a T
+        template<typename T>
+        T* getIf()
+        {
+            return std::get_if<T>(&storage);
+        }
+
+        // Must not be called on an empty record
+        const Event& get() const
+        {
+            return std::visit([](const auto& event) -> const Event&
+            {
+                if constexpr (std::is_same_v<std::decay_t<decltype(event)>, std::monostate>)
+                {
+                    throw std::bad_variant_access();
+                }
+                else
+                {
+                    return event;
+                }
+            }, storage);
+        }
+
+    private:
+        std::variant<std::monostate, WindowResizeEvent, QuitEvent, NextModelEvent, NextCubemapEvent, LightAzimuthChangeEvent,
+                     LightInclineChangeEvent, LuminanceChangeEvent, ScaleChangeEvent, CameraSpeedChangeEvent> storage;
+    };
+
+    // Holds at most one pending event per type, an event of a type already pending is merged into it,
+    // deltas are summed, camera speed factors multiplied and any other event type keeps only the latest
+    class EventCoalescer
+    {
+    public:
+        void add(const Event& event);
+        // Moves the pending event of type into record, returns false if none is pending
+        bool take(EventType type, EventRecord& record);
+        bool isPending(EventType type) const;
+        bool isEmpty() const;
+
+    private:
+        std::array<EventRecord, (size_t)EventType::Count> pending;
+    };
+
+    // Returns event as a T if it is one, nullptr otherwise, a cheaper dynamic_cast for concrete events
+    template<typename T>
+    const T* eventCast(const Event* event)
+    {
+        return event->getType() == T::TYPE ? static_cast<const T*>(event) : nullptr;
+    }
+
+    // Jump table from EventType to at most one handler, a subscriber registers a handler per
+    // event type it cares about and forwards notify to dispatch, so delivering an event costs
+    // the same no matter how many event types exist
+    class EventDispatcher
+    {
+    public:
+        template<typename T>
+        void on(std::function<void(const T&)> handler)
+        {
+            handlers[(size_t)T::TYPE] = [handler = std::move(handler)](const Event& event)
+            {
+                handler(static_cast<const T&>(event));
+            };
+        }
+
+        bool handles(EventType type) const
+        {
+            return (bool)handlers[(size_t)type];
+        }
+
+        // Returns false if no handler is registered for the type of event
+        bool dispatch(const Event* event) const
+        {
+            const auto& handler = handlers[(size_t)event->getType()];
+            if (!handler)
+            {
+                return false;
+            }
+            handler(*event);
+            return true;
+        }
+
+    private:
+        std::array<std::function<void(const Event&)>, (size_t)EventType::Count> handlers;
+    };
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+// Bounded lock-free queue that any number of threads can push to and a single thread pops from,
+// based on Dmitry Vyukov's bounded MPMC queue, every cell carries a sequence number telling
+// producers and the consumer whose turn it is so neither side ever takes a lock
+// tryPush never blocks or allocates, if the queue is full it returns false and counts the overflow,
+// leaving it to the producer to retry later or drop the item
+template <typename T>
+class EventQueue
+{
+public:
+    struct Stats
+    {
+        unsigned long long pushed;
+        unsigned long long popped;
+        unsigned long long overflows; // tryPush calls that failed because the queue was full
+    };
+
+    // capacity is rounded up to a power of two
+    explicit EventQueue(size_t capacity)
+    {
+        size_t roundedCapacity = 2;
+        while (roundedCapacity < capacity)
+        {
+            roundedCapacity *= 2;
+        }
+        mask = roundedCapacity - 1;
+
+        cells.reset(new Cell[roundedCapacity]);
+        for (size_t i = 0; i < roundedCapacity; ++i)
+        {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    EventQueue(const EventQueue&) = delete;
+    EventQueue& operator=(const EventQueue&) = delete;
+
+    // Safe to call from any thread
+    bool tryPush(const T& item)
+    {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell& cell = cells[pos & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+            if (diff == 0)
+            {
+                // The cell is free, claim it unless another producer got there first
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.item = item;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    pushed.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                // The consumer has not yet freed the cell from the previous lap
+                overflows.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else
+            {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Only called from the consuming thread, returns false if the queue is empty
+    bool tryPop(T& item)
+    {
+        Cell& cell = cells[dequeuePos & mask];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        if ((intptr_t)sequence - (intptr_t)(dequeuePos + 1) < 0)
+        {
+            return false;
+        }
+
+        item = cell.item;
+        cell.sequence.store(dequeuePos + mask + 1, std::memory_order_release);
+        ++dequeuePos;
+        popped.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    size_t getCapacity() const
+    {
+        return mask + 1;
+    }
+
+    Stats getStats() const
+    {
+        return { pushed.load(std::memory_order_relaxed), popped.load(std::memory_order_relaxed), overflows.load(std::memory_order_relaxed) };
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence{ 0 };
+        T item{};
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask = 0;
+
+    // Kept on separate cache lines so producers and the consumer do not invalidate each other
+    alignas(64) std::atomic<size_t> enqueuePos{ 0 };
+    alignas(64) size_t dequeuePos = 0;
+
+    alignas(64) std::atomic<unsigned long long> pushed{ 0 };
+    std::atomic<unsigned long long> popped{ 0 };
+    std::atomic<unsigned long long> overflows{ 0 };
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <glm/glm.hpp>
+
+struct CameraPose
+{
+    glm::vec3 cameraPos = glm::vec3(0.0f, 0.0f, 5.0f);
+    glm::vec3 targetPos = glm::vec3(0.0f, 0.0f, 0.0f);
+    glm::vec3 cameraUp = glm::vec3(0.0f, 1.0f, 0.0f);
+};
+
+// Everything the render thread needs from the simulation (main) thread to draw a frame, copied whole on publish
+struct FrameSnapshot
+{
+    // The camera before and after the latest fixed step, the render thread draws in between
+    // depending on how far it is into the next step, so motion is smooth at any refresh rate
+    CameraPose previous;
+    CameraPose current;
+    double stepTime = 0.0; // Seconds (see frame_timing.h getSeconds) at which the latest step was due
+    double stepDuration = 1.0 / 60.0;
+    unsigned long long simulationStep = 0; // Number of fixed updates run when the snapshot was taken
+
+    // Whether the camera drawn at time (in seconds) is the final one of the snapshot
+    bool isSettled(double time) const
+    {
+        return time >= stepTime + stepDuration
+            || (previous.cameraPos == current.cameraPos && previous.targetPos == current.targetPos && previous.cameraUp == current.cameraUp);
+    }
+
+    // Returns the camera at time (in seconds), clamped to the latest step
+    CameraPose interpolate(double time) const
+    {
+        float alpha = (float)glm::clamp((time - stepTime) / stepDuration, 0.0, 1.0);
+        CameraPose pose;
+        pose.cameraPos = glm::mix(previous.cameraPos, current.cameraPos, alpha);
+        pose.targetPos = glm::mix(previous.targetPos, current.targetPos, alpha);
+        pose.cameraUp = glm::normalize(glm::mix(previous.cameraUp, current.cameraUp, alpha));
+        return pose;
+    }
+};
+
+// Single producer, single consumer triple buffer where neither side ever waits for the other, the writer fills
+// getWriteSlot and publishes it, the reader acquires and then reads the latest published slot until its next acquire
+template <typename T>
+class TripleBuffer
+{
+public:
+    T& getWriteSlot()
+    {
+        return slots[writeIx];
+    }
+
+    void publish()
+    {
+        writeIx = shared.exchange(writeIx | NEW_BIT, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // Returns false, keeping the current read slot, if nothing has been published since the last acquire
+    bool acquire()
+    {
+        if ((shared.load(std::memory_order_relaxed) & NEW_BIT) == 0)
+        {
+            return false;
+        }
+
+        readIx = shared.exchange(readIx, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+    const T& getReadSlot() const
+    {
+        return slots[readIx];
+    }
+
+private:
+    static const unsigned int INDEX_MASK = 3;
+    static const unsigned int NEW_BIT = 4;
+
+    T slots[3];
+    std::atomic<unsigned int> shared{ 1 }; // Index of the slot between writer and reader, with NEW_BIT if not yet read
+    unsigned int writeIx = 0;
+    unsigned int readIx = 2;
+};
@@ -0,0 +1,89 @@
+#include <algorithm>
+
+#include "frame_timing.h"
+
+double getSeconds()
+{
+    static const double secondsPerCount = 1.0 / (double)SDL_GetPerformanceFrequency();
+    return (double)SDL_GetPerformanceCounter() * secondsPerCount;
+}
+
+FrameTimer::FrameTimer()
+{
+    frameStart = getSeconds();
+    workDone = frameStart;
+}
+
+void FrameTimer::markFrameStart()
+{
+    frameStart = getSeconds();
+}
+
+void FrameTimer::markWorkDone()
+{
+    workDone = getSeconds();
+}
+
+void FrameTimer::markFrameEnd()
+{
+    double frameEnd = getSeconds();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.frameMs = (float)((frameEnd - frameStart) * 1000.0);
+    stats.workMs = (float)((workDone - frameStart) * 1000.0);
+    history[stats.frameCount % FRAME_HISTORY] = stats.frameMs;
+    ++stats.frameCount;
+
+    size_t count = (size_t)std::min<unsigned long long>(stats.frameCount, FRAME_HISTORY);
+    float sum = 0.0f;
+    stats.minFrameMs = history[0];
+    stats.maxFrameMs = history[0];
+    for (size_t i = 0; i < count; ++i)
+    {
+        sum += history[i];
+        stats.minFrameMs = std::min(stats.minFrameMs, history[i]);
+        stats.maxFrameMs = std::max(stats.maxFrameMs, history[i]);
+    }
+    stats.averageFrameMs = sum / count;
+
+    frameStart = frameEnd;
+}
+
+FrameStats FrameTimer::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+FrameLimiter::FrameLimiter(int maxFps)
+{
+    frameDuration = maxFps > 0 ? 1.0 / maxFps : 0.0;
+    nextFrameTime = getSeconds() + frameDuration;
+}
+
+void FrameLimiter::wait()
+{
+    if (frameDuration == 0.0)
+    {
+        return;
+    }
+
+    double now = getSeconds();
+    double remaining = nextFrameTime - now;
+    if (remaining > SPIN_SECONDS)
+    {
+        SDL_Delay((Uint32)((remaining - SPIN_SECONDS) * 1000.0));
+    }
+    while (getSeconds() < nextFrameTime)
+    {
+        // Spin, SDL_Delay is only accurate to about a millisecond
+    }
+
+    // After a late frame the schedule restarts from now, instead of shortening the following frames to catch up
+    nextFrameTime += frameDuration;
+    now = getSeconds();
+    if (nextFrameTime < now)
+    {
+        nextFrameTime = now + frameDuration;
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <mutex>
+#include <array>
+
+// Seconds since an arbitrary point, from SDL's high resolution performance counter
+double getSeconds();
+
+struct FrameStats
+{
+    unsigned long long frameCount = 0;
+    float frameMs = 0.0f;        // Between the last two presents
+    float workMs = 0.0f;         // Spent preparing and submitting the last frame, without limiter waits and the swap
+    float averageFrameMs = 0.0f; // Over the last FRAME_HISTORY frames
+    float minFrameMs = 0.0f;
+    float maxFrameMs = 0.0f;
+};
+
+// Measures frame and work times on the render thread, getStats can be called from any thread
+class FrameTimer
+{
+public:
+    static const size_t FRAME_HISTORY = 120;
+
+    FrameTimer();
+
+    // Call after idling between frames, so the idle time does not count towards the frame
+    void markFrameStart();
+    // Call when the frame's work is done, before waiting for the limiter or swapping
+    void markWorkDone();
+    // Call right after presenting, starts the next frame
+    void markFrameEnd();
+
+    FrameStats getStats() const;
+
+private:
+    double frameStart;
+    double workDone;
+
+    mutable std::mutex mutex;
+    FrameStats stats;
+    std::array<float, FRAME_HISTORY> history = {};
+};
+
+// Caps the frame rate without burning a core, wait sleeps for most of the remaining
+// frame time and spins only for the last SPIN_SECONDS where sleeping is too coarse
+class FrameLimiter
+{
+public:
+    // maxFps of 0 disables the limiter
+    explicit FrameLimiter(int maxFps);
+
+    void wait();
+
+private:
+    static constexpr double SPIN_SECONDS = 0.002;
+
+    double frameDuration;
+    double nextFrameTime;
+};
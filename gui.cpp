@@ -5,6 +5,7 @@
 #include <random>
 #include <locale>
 #include <codecvt>
+#include <algorithm>
 
 #include "gui.h"
 #include "shaders.h"
@@ -12,8 +13,262 @@
 
 namespace gui
 {
+    GUIFontAtlas* GUIFontAtlas::instance = nullptr;
+
+    GUIFontAtlas* GUIFontAtlas::getInstance()
+    {
+        if (instance == nullptr)
+        {
+            instance = new GUIFontAtlas();
+        }
+
+        return instance;
+    }
+
+    void GUIFontAtlas::destroy()
+    {
+        delete instance;
+        instance = nullptr;
+    }
+
+    GUIFontAtlas::~GUIFontAtlas()
+    {
+        for (auto* group : groups)
+        {
+            glDeleteTextures(1, &group->textureID);
+            delete group;
+        }
+    }
+
+    const GUIFontAtlas::ArrayGroup* GUIFontAtlas::acquireFont(text::Font* font)
+    {
+        auto fontIt = fontGroups.find(font);
+        if (fontIt != fontGroups.end())
+        {
+            return fontIt->second;
+        }
+
+        std::vector<std::filesystem::path> pngPaths = font->getPngPaths();
+        if (pngPaths.empty())
+        {
+            std::cerr << "Font " << font->getFontName() << " has no atlas pages, unable to add it to a texture array" << std::endl;
+            return nullptr;
+        }
+
+        int width = (int)font->getTextureWidth();
+        int height = (int)font->getTextureHeight();
+        auto groupIt = std::find_if(groups.begin(), groups.end(), [width, height](const ArrayGroup* group)
+        {
+            return group->width == width && group->height == height;
+        });
+
+        ArrayGroup* group = nullptr;
+        if (groupIt != groups.end())
+        {
+            group = *groupIt;
+        }
+        else
+        {
+            group = new ArrayGroup();
+            group->width = width;
+            group->height = height;
+            groups.emplace_back(group);
+        }
+
+        // Texture array storage is immutable, so adding a Font means creating a
+        // larger array, copying the existing layers over and loading the new pages
+        int firstLayer = group->layerCount;
+        int newLayerCount = group->layerCount + (int)pngPaths.size();
+        GLuint newTextureID = texturel::createTextureArray(width, height, newLayerCount, 3, group->textureID, group->layerCount);
+        for (size_t i = 0; i < pngPaths.size(); ++i)
+        {
+            if (!texturel::loadTextureArrayLayer(newTextureID, firstLayer + (int)i, width, height, pngPaths[i]))
+            {
+                std::cerr << "Failed to load atlas page " << i << " of font " << font->getFontName() << " into texture array" << std::endl;
+                glDeleteTextures(1, &newTextureID);
+                return nullptr;
+            }
+        }
+
+        if (group->textureID != 0)
+        {
+            glDeleteTextures(1, &group->textureID);
+        }
+        group->textureID = newTextureID;
+        group->layerCount = newLayerCount;
+
+        font->setAtlasLayer(firstLayer);
+        fontGroups[font] = group;
+
+        return group;
+    }
+
+    const GUIFontAtlas::ArrayGroup* GUIFontAtlas::getGroup(text::Font* font) const
+    {
+        auto it = fontGroups.find(font);
+        if (it == fontGroups.end())
+        {
+            return nullptr;
+        }
+
+        return it->second;
+    }
+
+    GUIHandle GUILayoutPool::create(GUIElement* element, int xPos, int yPos, int width, int height, bool isVisible, glm::vec4 color)
+    {
+        uint32_t slot;
+        if (!freeSlots.empty())
+        {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+
+            this->xPos[slot] = xPos;
+            this->yPos[slot] = yPos;
+            this->width[slot] = width;
+            this->height[slot] = height;
+            this->isVisible[slot] = isVisible;
+            this->color[slot] = color;
+            parent[slot] = NONE;
+            firstChild[slot] = NONE;
+            lastChild[slot] = NONE;
+            nextSibling[slot] = NONE;
+            prevSibling[slot] = NONE;
+            inputStamp[slot] = 0;
+            elements[slot] = element;
+        }
+        else
+        {
+            slot = (uint32_t)elements.size();
+
+            this->xPos.emplace_back(xPos);
+            this->yPos.emplace_back(yPos);
+            this->width.emplace_back(width);
+            this->height.emplace_back(height);
+            this->isVisible.emplace_back(isVisible);
+            this->color.emplace_back(color);
+            parent.emplace_back(NONE);
+            firstChild.emplace_back(NONE);
+            lastChild.emplace_back(NONE);
+            nextSibling.emplace_back(NONE);
+            prevSibling.emplace_back(NONE);
+            inputStamp.emplace_back(0);
+            elements.emplace_back(element);
+            generations.emplace_back(0);
+        }
+
+        return { slot, generations[slot] };
+    }
+
+    void GUILayoutPool::destroy(GUIHandle handle)
+    {
+        if (!isValid(handle))
+        {
+            return;
+        }
+
+        unlinkChild(handle.index);
+        elements[handle.index] = nullptr;
+        // Any handle still pointing at this slot is now stale
+        ++generations[handle.index];
+        freeSlots.emplace_back(handle.index);
+    }
+
+    bool GUILayoutPool::isValid(GUIHandle handle) const
+    {
+        return handle.index < elements.size() && generations[handle.index] == handle.generation && elements[handle.index] != nullptr;
+    }
+
+    GUIHandle GUILayoutPool::getHandle(uint32_t slot) const
+    {
+        return { slot, generations[slot] };
+    }
+
+    void GUILayoutPool::appendChild(uint32_t parentSlot, uint32_t childSlot)
+    {
+        unlinkChild(childSlot);
+
+        parent[childSlot] = parentSlot;
+        prevSibling[childSlot] = lastChild[parentSlot];
+        nextSibling[childSlot] = NONE;
+
+        if (lastChild[parentSlot] != NONE)
+        {
+            nextSibling[lastChild[parentSlot]] = childSlot;
+        }
+        else
+        {
+            firstChild[parentSlot] = childSlot;
+        }
+        lastChild[parentSlot] = childSlot;
+    }
+
+    void GUILayoutPool::unlinkChild(uint32_t childSlot)
+    {
+        uint32_t parentSlot = parent[childSlot];
+        if (parentSlot == NONE)
+        {
+            return;
+        }
+
+        if (prevSibling[childSlot] != NONE)
+        {
+            nextSibling[prevSibling[childSlot]] = nextSibling[childSlot];
+        }
+        else
+        {
+            firstChild[parentSlot] = nextSibling[childSlot];
+        }
+
+        if (nextSibling[childSlot] != NONE)
+        {
+            prevSibling[nextSibling[childSlot]] = prevSibling[childSlot];
+        }
+        else
+        {
+            lastChild[parentSlot] = prevSibling[childSlot];
+        }
+
+        parent[childSlot] = NONE;
+        nextSibling[childSlot] = NONE;
+        prevSibling[childSlot] = NONE;
+    }
+
+    uint32_t GUILayoutPool::nextInSubtree(uint32_t slot, uint32_t rootSlot) const
+    {
+        if (firstChild[slot] != NONE)
+        {
+            return firstChild[slot];
+        }
+
+        while (slot != rootSlot)
+        {
+            if (nextSibling[slot] != NONE)
+            {
+                return nextSibling[slot];
+            }
+            slot = parent[slot];
+        }
+
+        return NONE;
+    }
+
+    size_t GUILayoutPool::size() const
+    {
+        return elements.size();
+    }
+
     GUIHandler::GUIHandler(float windowWidth, float windowHeight)
-        : windowWidth(windowWidth), windowHeight(windowHeight) {}
+        : windowWidth(windowWidth), windowHeight(windowHeight) 
+    {
+        rebuildGrid();
+
+        eventDispatcher.on<event::WindowResizeEvent>([this](const event::WindowResizeEvent& e)
+        {
+            this->windowWidth = (float)e.newWidth;
+            this->windowHeight = (float)e.newHeight;
+            rebuildGrid();
+        });
+    }
 
     // GUIElement lifetime bound to GUIHandler
     // Seems like GUIElement members will be deleted (and removed from elements) before GUIHandler
@@ -21,171 +276,797 @@ namespace gui
     // "delete element" can be called to remove delete element and remove it from elements externally
     GUIHandler::~GUIHandler()
     {
-        if (!zIndexRootElementMap.empty())
+        // Root elements remove themselves from the z-order list when deleted
+        while (bottomRootElement != nullptr)
         {
-            for (auto& pair : zIndexRootElementMap)
+            delete bottomRootElement;
+        }
+
+        glDeleteFramebuffers(1, &cacheFBO);
+        glDeleteTextures(1, &cacheTexture);
+        glDeleteVertexArrays(1, &compositeVAO);
+        glDeleteProgram(compositeProgram);
+
+        for (const SharedProgram& shared : sharedPrograms)
+        {
+            glDeleteProgram(shared.program);
+        }
+        glDeleteVertexArrays(1, &unitQuadVAO);
+        glDeleteBuffers(1, &unitQuadVBO);
+        glDeleteBuffers(1, &unitQuadEBO);
+    }
+
+    void GUIHandler::notify(const event::Event* event) 
+    {
+        eventDispatcher.dispatch(event);
+    }
+
+    float GUIHandler::getWindowWidth() const
+    {
+        return windowWidth;
+    }
+
+    float GUIHandler::getWindowHeight() const
+    {
+        return windowHeight;
+    }
+
+    void GUIHandler::addElement(GUIElement* element)
+    {
+        element->zPrev = topRootElement;
+        element->zNext = nullptr;
+        if (topRootElement != nullptr)
+        {
+            topRootElement->zNext = element;
+        }
+        else
+        {
+            bottomRootElement = element;
+        }
+        topRootElement = element;
+
+        element->zOrder = ++topZOrder;
+        ++rootElementCount;
+    }
+
+    void GUIHandler::removeElement(GUIElement* element)
+    {
+        if (element->zPrev == nullptr && element->zNext == nullptr && bottomRootElement != element)
+        {
+            std::cerr << "Element not a member of elements, unable to remove from elements" << std::endl;
+            return;
+        }
+
+        if (element->zPrev != nullptr)
+        {
+            element->zPrev->zNext = element->zNext;
+        }
+        else
+        {
+            bottomRootElement = element->zNext;
+        }
+
+        if (element->zNext != nullptr)
+        {
+            element->zNext->zPrev = element->zPrev;
+        }
+        else
+        {
+            topRootElement = element->zPrev;
+        }
+
+        element->zPrev = nullptr;
+        element->zNext = nullptr;
+        --rootElementCount;
+    }
+
+    void GUIHandler::raiseElement(GUIElement* element)
+    {
+        if (element == topRootElement)
+        {
+            return;
+        }
+
+        removeElement(element);
+        addElement(element);
+
+        // Changes what is drawn on top wherever the element overlaps other roots
+        markSubtreeDirty(element);
+    }
+
+    void GUIHandler::lowerElement(GUIElement* element)
+    {
+        if (element == bottomRootElement)
+        {
+            return;
+        }
+
+        removeElement(element);
+        element->zPrev = nullptr;
+        element->zNext = bottomRootElement;
+        if (bottomRootElement != nullptr)
+        {
+            bottomRootElement->zPrev = element;
+        }
+        else
+        {
+            topRootElement = element;
+        }
+        bottomRootElement = element;
+
+        element->zOrder = --bottomZOrder;
+        ++rootElementCount;
+
+        markSubtreeDirty(element);
+    }
+
+    void GUIHandler::prepareGUIRendering() const
+    {
+        glEnable(GL_BLEND);
+        // Alpha is accumulated separately so that the offscreen texture ends up with premultiplied colors
+        glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        glDisable(GL_DEPTH_TEST);
+    }
+
+    void GUIHandler::finishGUIRendering() const
+    {
+        glDisable(GL_SCISSOR_TEST);
+        glEnable(GL_DEPTH_TEST);
+        glDisable(GL_BLEND);
+    }
+
+    bool GUIHandler::renderAllElements()
+    {
+        for (GUIElement* element : animatedElements)
+        {
+            element->updateAnimation();
+        }
+
+        if (cacheWidth != (int)windowWidth || cacheHeight != (int)windowHeight)
+        {
+            cacheValid = initializeCache();
+        }
+
+        SDL_Rect windowRect = { 0, 0, (int)windowWidth, (int)windowHeight };
+        if (!cacheValid)
+        {
+            // Without the offscreen texture, draw every element straight to the framebuffer
+            clipRect = windowRect;
+            prepareGUIRendering();
+            bool result = renderElements();
+            finishGUIRendering();
+
+            return result;
+        }
+
+        bool result = true;
+        if (!dirtyRects.empty())
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, cacheFBO);
+            prepareGUIRendering();
+            glEnable(GL_SCISSOR_TEST);
+            glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+
+            // Every element is submitted for each region, the scissor keeps the rest of the texture untouched
+            for (const SDL_Rect& rect : dirtyRects)
             {
-                auto e = pair.second;
-                if (e != nullptr)
+                clipRect = rect;
+                resetScissor();
+                glClear(GL_COLOR_BUFFER_BIT);
+
+                if (!renderElements())
                 {
-                    delete e;
+                    result = false;
                 }
             }
+
+            finishGUIRendering();
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+            dirtyRects.clear();
+            clipRect = windowRect;
+        }
+
+        // Composite the cached GUI over the scene
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        glDisable(GL_DEPTH_TEST);
+
+        glUseProgram(compositeProgram);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, cacheTexture);
+        glUniform1i(compositeTextureLoc, 0);
+
+        glBindVertexArray(compositeVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+
+        // Clean up
+        glBindVertexArray(0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glEnable(GL_DEPTH_TEST);
+        glDisable(GL_BLEND);
+
+        // Check for OpenGL errors
+        GLenum error = glGetError();
+        if (error != GL_NO_ERROR)
+        {
+            std::cerr << "Error when compositing GUI, OpenGL error: " << error << std::endl;
+            return false;
         }
+
+        return result;
     }
 
-    void GUIHandler::notify(const event::Event* event) 
+    bool GUIHandler::renderElements() const
     {
-        if (const event::WindowResizeEvent* resizeEvent = dynamic_cast<const event::WindowResizeEvent*>(event)) 
+        bool result = true;
+        for (GUIElement* e = bottomRootElement; e != nullptr; e = e->zNext)
         {
-            windowWidth = (float)resizeEvent->newWidth;
-            windowHeight = (float)resizeEvent->newHeight;
+            if (e->getIsVisible())
+            {
+                if (!e->render())
+                {
+                    std::cerr << "Issue rendering individual GUIElement when rendering all elements in renderVector" << std::endl;
+                    result = false;
+                }
+            }
+        }
+
+        return result;
+    }
+
+    bool GUIHandler::initializeCache()
+    {
+        cacheWidth = (int)windowWidth;
+        cacheHeight = (int)windowHeight;
+        if (cacheWidth <= 0 || cacheHeight <= 0)
+        {
+            return false; // E.g. minimized window
+        }
+
+        if (compositeProgram == 0)
+        {
+            compositeProgram = shaders::createShaderProgram(shaders::guiCompositeVertexShaderSource, shaders::guiCompositeFragmentShaderSource);
+            if (compositeProgram == 0)
+            {
+                std::cerr << "Failed to create GUI composite shader program" << std::endl;
+                return false;
+            }
+            compositeTextureLoc = glGetUniformLocation(compositeProgram, "guiTexture");
+
+            // The fullscreen triangle has no vertex attributes, but core profile still requires a bound VAO
+            glGenVertexArrays(1, &compositeVAO);
+        }
+
+        glDeleteTextures(1, &cacheTexture);
+        glGenTextures(1, &cacheTexture);
+        glBindTexture(GL_TEXTURE_2D, cacheTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, cacheWidth, cacheHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        if (cacheFBO == 0)
+        {
+            glGenFramebuffers(1, &cacheFBO);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, cacheFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, cacheTexture, 0);
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        if (status != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cerr << "GUI framebuffer incomplete, status: " << status << ", rendering GUI directly instead" << std::endl;
+            return false;
+        }
+
+        // The new texture has undefined contents
+        dirtyRects.clear();
+        markDirty(0, 0, cacheWidth, cacheHeight);
+
+        return true;
+    }
+
+    bool GUIHandler::handlesEventType(Uint32 type) const
+    {
+        switch (type)
+        {
+        case SDL_MOUSEMOTION:
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP:
+        case SDL_KEYDOWN:
+        case SDL_TEXTINPUT:
+            return true;
+
+        default:
+            return false;
+        }
+    }
+
+    bool GUIHandler::receiveInputAllElements(const SDL_Event* event, InputState* inputState)
+    {
+        // Pointer events only visit the active element, the elements under the cursor and their ancestors,
+        // any other element would either reject the event or not be hit by it
+        bool isPointerEvent = event->type == SDL_MOUSEMOTION || event->type == SDL_MOUSEBUTTONDOWN || event->type == SDL_MOUSEBUTTONUP;
+        if (isPointerEvent)
+        {
+            // Only an element being moved or resized reacts to motion, and that is always the active element
+            if (event->type == SDL_MOUSEMOTION && activeElement == nullptr)
+            {
+                return false;
+            }
+
+            ++inputStamp;
+            candidateRoots.clear();
+            if (activeElement != nullptr)
+            {
+                markElementAndAncestors(activeElement->handle.index);
+            }
+            if (event->type != SDL_MOUSEMOTION)
+            {
+                markElementsAt(event->button.x, (int)windowHeight - event->button.y); // Conversion from top-left to bottom-left system
+            }
+            filterInput = true;
+
+            // Topmost first, as when walking the whole z-order
+            std::sort(candidateRoots.begin(), candidateRoots.end(), [](GUIElement* a, GUIElement* b) { return a->zOrder > b->zOrder; });
+        }
+
+        GUIElement* consumer = nullptr;
+        if (isPointerEvent)
+        {
+            for (GUIElement* e : candidateRoots)
+            {
+                if (e->receiveInput(event, inputState))
+                {
+                    consumer = e;
+                    break; // Stop propagation on event consumed
+                }
+            }
+        }
+        else
+        {
+            for (GUIElement* e = topRootElement; e != nullptr; e = e->zPrev)
+            {
+                if (e->receiveInput(event, inputState))
+                {
+                    consumer = e;
+                    break; // Stop propagation on event consumed
+                }
+            }
+        }
+        filterInput = false;
+
+        if (consumer != nullptr)
+        {
+            raiseElement(consumer);
+            return true;
+        }
+
+        // Releasing the button anywhere hands the mouse back to the camera, as skipped elements would have done
+        if (event->type == SDL_MOUSEBUTTONUP && event->button.button == SDL_BUTTON_LEFT)
+        {
+            inputState->setMouseState(InputState::CameraControl);
+        }
+
+        return false; // No element consumed the event
+    }
+
+    GUIElement* GUIHandler::getBottomRootElement() const
+    {
+        return bottomRootElement;
+    }
+
+    GUIElement* GUIHandler::getTopRootElement() const
+    {
+        return topRootElement;
+    }
+
+    size_t GUIHandler::getRootElementCount() const
+    {
+        return rootElementCount;
+    }
+
+    GUIElement* GUIHandler::getActiveElement()
+    {
+        return activeElement;
+    }
+    
+    // TODO: Use dynamic cast to make changes when an activeElement
+    // of certain type is swapped out, e.g. beingEdited for edit text
+    void GUIHandler::setActiveElement(GUIElement* element)
+    {
+        activeElement = element;
+    }
+
+    void GUIHandler::setTextInputToggle(std::function<void(bool)> toggle)
+    {
+        textInputToggle = std::move(toggle);
+    }
+
+    void GUIHandler::setTextInputActive(bool active)
+    {
+        if (textInputToggle)
+        {
+            textInputToggle(active);
+        }
+        else if (active)
+        {
+            SDL_StartTextInput();
+        }
+        else
+        {
+            SDL_StopTextInput();
+        }
+    }
+
+    bool GUIHandler::isOrContainsActiveElement(GUIElement* element)
+    {   
+        // Walk up from the active element rather than down through every child of element
+        if (activeElement == nullptr)
+        {
+            return false;
+        }
+
+        for (uint32_t slot = activeElement->handle.index; slot != GUILayoutPool::NONE; slot = layout.parent[slot])
+        {
+            if (slot == element->handle.index)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    GUIElement* GUIHandler::getElement(GUIHandle handle) const
+    {
+        if (!layout.isValid(handle))
+        {
+            return nullptr;
         }
+
+        return layout.elements[handle.index];
     }
 
-    float GUIHandler::getWindowWidth() const
-    {
-        return windowWidth;
-    }
+    void GUIHandler::updateElementBounds(uint32_t slot)
+    {
+        if (elementBounds.size() < layout.size())
+        {
+            elementBounds.resize(layout.size());
+        }
+
+        SDL_Rect newRect = { layout.xPos[slot], layout.yPos[slot], layout.width[slot], layout.height[slot] };
+        // Corners can be grabbed up to borderWidth outside of the element
+        int border = std::max(0, layout.elements[slot]->borderWidth);
+        SDL_Rect newHitRect = { newRect.x - border, newRect.y - border, newRect.w + 2 * border, newRect.h + 2 * border };
+        GridRange newRange = getGridRange(newHitRect);
+
+        ElementBounds& bounds = elementBounds[slot];
+        if (bounds.inGrid)
+        {
+            if (bounds.rect.x == newRect.x && bounds.rect.y == newRect.y && bounds.rect.w == newRect.w && bounds.rect.h == newRect.h)
+            {
+                return;
+            }
+
+            // Both where the element was and where it is now have to be redrawn
+            markDirty(bounds.rect.x, bounds.rect.y, bounds.rect.w, bounds.rect.h);
+            markDirty(newRect.x, newRect.y, newRect.w, newRect.h);
+
+            const GridRange& oldRange = bounds.range;
+            // Most moves stay within the same cells
+            if (oldRange.x0 == newRange.x0 && oldRange.y0 == newRange.y0 && oldRange.x1 == newRange.x1 && oldRange.y1 == newRange.y1)
+            {
+                bounds.rect = newRect;
+                bounds.hitRect = newHitRect;
+                return;
+            }
+
+            for (int y = oldRange.y0; y <= oldRange.y1; ++y)
+            {
+                for (int x = oldRange.x0; x <= oldRange.x1; ++x)
+                {
+                    std::vector<uint32_t>& cell = gridCells[y * gridColumns + x];
+                    auto cellIt = std::find(cell.begin(), cell.end(), slot);
+                    if (cellIt != cell.end())
+                    {
+                        *cellIt = cell.back();
+                        cell.pop_back();
+                    }
+                }
+            }
+        }
+        else
+        {
+            markDirty(newRect.x, newRect.y, newRect.w, newRect.h);
+        }
+
+        for (int y = newRange.y0; y <= newRange.y1; ++y)
+        {
+            for (int x = newRange.x0; x <= newRange.x1; ++x)
+            {
+                gridCells[y * gridColumns + x].emplace_back(slot);
+            }
+        }
+
+        bounds.rect = newRect;
+        bounds.hitRect = newHitRect;
+        bounds.range = newRange;
+        bounds.inGrid = true;
+    }
+
+    void GUIHandler::removeElementBounds(uint32_t slot)
+    {
+        if (slot >= elementBounds.size() || !elementBounds[slot].inGrid)
+        {
+            return;
+        }
+
+        ElementBounds& bounds = elementBounds[slot];
+        markDirty(bounds.rect.x, bounds.rect.y, bounds.rect.w, bounds.rect.h);
+
+        for (int y = bounds.range.y0; y <= bounds.range.y1; ++y)
+        {
+            for (int x = bounds.range.x0; x <= bounds.range.x1; ++x)
+            {
+                std::vector<uint32_t>& cell = gridCells[y * gridColumns + x];
+                cell.erase(std::remove(cell.begin(), cell.end(), slot), cell.end());
+            }
+        }
+
+        bounds.inGrid = false;
+    }
+
+    bool GUIHandler::isInputCandidate(uint32_t slot) const
+    {
+        return !filterInput || layout.inputStamp[slot] == inputStamp;
+    }
+
+    void GUIHandler::markDirty(int x, int y, int width, int height)
+    {
+        // Padded by a pixel for fragments rasterized on the edges
+        SDL_Rect rect = { x - 1, y - 1, width + 2, height + 2 };
+        SDL_Rect windowRect = { 0, 0, (int)windowWidth, (int)windowHeight };
+        SDL_Rect clipped;
+        if (!SDL_IntersectRect(&rect, &windowRect, &clipped))
+        {
+            return;
+        }
+
+        // Merge overlapping regions so the same pixels are not redrawn twice
+        for (SDL_Rect& dirtyRect : dirtyRects)
+        {
+            if (SDL_HasIntersection(&dirtyRect, &clipped))
+            {
+                SDL_Rect merged;
+                SDL_UnionRect(&dirtyRect, &clipped, &merged);
+                dirtyRect = merged;
+                return;
+            }
+        }
+
+        dirtyRects.emplace_back(clipped);
+        if (dirtyRects.size() > maxDirtyRects)
+        {
+            SDL_Rect bounds = dirtyRects[0];
+            for (const SDL_Rect& dirtyRect : dirtyRects)
+            {
+                SDL_UnionRect(&bounds, &dirtyRect, &bounds);
+            }
+            dirtyRects.assign(1, bounds);
+        }
+    }
+
+    void GUIHandler::setScissor(int x, int y, int width, int height) const
+    {
+        SDL_Rect rect = { x, y, width, height };
+        SDL_Rect clipped = { 0, 0, 0, 0 };
+        SDL_IntersectRect(&rect, &clipRect, &clipped);
+        glScissor(clipped.x, clipped.y, clipped.w, clipped.h);
+    }
+
+    void GUIHandler::resetScissor() const
+    {
+        glScissor(clipRect.x, clipRect.y, clipRect.w, clipRect.h);
+    }
+
+    void GUIHandler::setAnimating(GUIElement* element, bool animating)
+    {
+        if (animating)
+        {
+            animatedElements.emplace(element);
+        }
+        else
+        {
+            animatedElements.erase(element);
+        }
+    }
+
+    std::chrono::steady_clock::time_point GUIHandler::getNextAnimationTime() const
+    {
+        auto next = std::chrono::steady_clock::time_point::max();
+        for (const GUIElement* element : animatedElements)
+        {
+            next = std::min(next, element->getNextAnimationTime());
+        }
+        return next;
+    }
+
+    GLuint GUIHandler::getSharedProgram(const GLchar* vertexShaderSource, const GLchar* fragmentShaderSource)
+    {
+        // Sources are static strings from shaders.h, so comparing pointers is enough
+        for (const SharedProgram& shared : sharedPrograms)
+        {
+            if (shared.vertexShaderSource == vertexShaderSource && shared.fragmentShaderSource == fragmentShaderSource)
+            {
+                return shared.program;
+            }
+        }
+
+        GLuint program = shaders::createShaderProgram(vertexShaderSource, fragmentShaderSource);
+        if (program != 0)
+        {
+            sharedPrograms.push_back({ vertexShaderSource, fragmentShaderSource, program });
+        }
+
+        return program;
+    }
+
+    GLuint GUIHandler::getUnitQuadVAO()
+    {
+        if (unitQuadVAO != 0)
+        {
+            return unitQuadVAO;
+        }
+
+        // Define 1x1 square with bottom-left square corner at origin
+        float vertices[] = {
+            0.0f, 0.0f, 0.0f,
+            1.0f, 0.0f, 0.0f,
+            1.0f, 1.0f, 0.0f,
+            0.0f, 1.0f, 0.0f
+        };
+
+        // Define the square's indices
+        unsigned int indices[] = {
+            0, 1, 2,
+            2, 3, 0
+        };
+
+        glGenVertexArrays(1, &unitQuadVAO);
+        glBindVertexArray(unitQuadVAO);
+
+        glGenBuffers(1, &unitQuadVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, unitQuadVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+        glGenBuffers(1, &unitQuadEBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, unitQuadEBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+        // Set the vertex attributes pointers
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
 
-    float GUIHandler::getWindowHeight() const
-    {
-        return windowHeight;
-    }
+        glBindVertexArray(0);
 
-    void GUIHandler::addElement(GUIElement* element, int zIndex)
-    {
-        zIndexRootElementMap.emplace(zIndex, element);
+        return unitQuadVAO;
     }
 
-    void GUIHandler::removeElement(GUIElement* element)
+    bool GUIHandler::recordElementUniforms(GLuint program, int width, int height, int cornerRadius) const
     {
-        for (auto it = zIndexRootElementMap.begin(); it != zIndexRootElementMap.end(); ++it)
+        ElementUniforms& last = lastElementUniforms;
+        if (last.program == program && last.width == width && last.height == height && last.cornerRadius == cornerRadius)
         {
-            if(it->second == element)
-            {
-                zIndexRootElementMap.erase(it);
-                return;  // Return after the first matching element is found and removed
-            }
+            return false;
         }
 
-        std::cerr << "Element not a member of elements, unable to remove from elements" << std::endl;
-    }
-
-    void GUIHandler::prepareGUIRendering() const
-    {
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        glDisable(GL_DEPTH_TEST);
+        last.program = program;
+        last.width = width;
+        last.height = height;
+        last.cornerRadius = cornerRadius;
+        return true;
     }
 
-    void GUIHandler::finishGUIRendering() const
+    void GUIHandler::markSubtreeDirty(GUIElement* element)
     {
-        glEnable(GL_DEPTH_TEST);
-        glDisable(GL_BLEND);
+        uint32_t root = element->handle.index;
+        for (uint32_t slot = root; slot != GUILayoutPool::NONE; slot = layout.nextInSubtree(slot, root))
+        {
+            markDirty(layout.xPos[slot], layout.yPos[slot], layout.width[slot], layout.height[slot]);
+        }
     }
 
-    bool GUIHandler::renderAllElements() const
+    void GUIHandler::rebuildGrid()
     {
-        prepareGUIRendering();
+        gridColumns = std::max(1, ((int)windowWidth + gridCellSize - 1) / gridCellSize);
+        gridRows = std::max(1, ((int)windowHeight + gridCellSize - 1) / gridCellSize);
+        gridCells.assign(gridColumns * gridRows, std::vector<uint32_t>());
 
-        bool result = true;
-        for (auto& pair : zIndexRootElementMap)
+        for (uint32_t slot = 0; slot < (uint32_t)elementBounds.size(); ++slot)
         {
-            auto e = pair.second;
-            if (e->getIsVisible())
+            ElementBounds& bounds = elementBounds[slot];
+            if (!bounds.inGrid)
             {
-                if (!e->render())
-                {
-                    std::cerr << "Issue rendering individual GUIElement when rendering all elements in renderVector" << std::endl;
-                    result = false;
-                }
+                continue;
             }
-        }
-
-        finishGUIRendering();
-
-        return result;
-    }
 
-    bool GUIHandler::receiveInputAllElements(const SDL_Event* event, InputState* inputState)
-    {
-        int i = (int)zIndexRootElementMap.size();
-        for (auto it = zIndexRootElementMap.rbegin(); it != zIndexRootElementMap.rend(); ++it)
-        {
-            auto e = it->second;
-            /* std::cout << "ELEMENT " << i << " position, x: " << e->getXPos() << ", y: " << e->getYPos() << std::endl; */
-            if (e->receiveInput(event, inputState))
+            bounds.range = getGridRange(bounds.hitRect);
+            for (int y = bounds.range.y0; y <= bounds.range.y1; ++y)
             {
-                int maxZIndex = zIndexRootElementMap.rbegin()->first;  // Get max zIndex after consuming the event
-                if (maxZIndex > 1000)
+                for (int x = bounds.range.x0; x <= bounds.range.x1; ++x)
                 {
-                    normalizeZIndices();
-                    maxZIndex = zIndexRootElementMap.rbegin()->first;
+                    gridCells[y * gridColumns + x].emplace_back(slot);
                 }
-
-                /* std::cout << "ELEMENT " << i << " consumed event " << event->type << ", current maxZIndex: " << maxZIndex << std::endl; */
-                removeElement(e); // Remove element from zIndexRootElementMap with now old zIndex
-                addElement(e, maxZIndex + 1); // Re-add element to zIndexRootElementMap with new zIndex
-                return true; // Stop propagation on event consumed
             }
-            --i;
-            /* std::cout << std::endl; */
         }
-
-        return false; // No element consumed the event
     }
 
-    std::multimap<int, GUIElement*> GUIHandler::getZIndexRootElementMap()
+    GUIHandler::GridRange GUIHandler::getGridRange(const SDL_Rect& hitRect) const
     {
-        return zIndexRootElementMap;
-    }
-
-    void GUIHandler::normalizeZIndices()
-    {
-        std::multimap<int, GUIElement*> newZIndexRootElementMap;
-        int newZIndex = 0;
+        int left = hitRect.x;
+        int right = hitRect.x + hitRect.w;
+        int bottom = hitRect.y;
+        int top = hitRect.y + hitRect.h;
 
-        for (auto& pair : zIndexRootElementMap)
+        GridRange range;
+        if (right < 0 || top < 0 || left >= (int)windowWidth || bottom >= (int)windowHeight)
         {
-            newZIndexRootElementMap.emplace(newZIndex++, pair.second);
+            return range; // Fully outside the window, never under the cursor
         }
 
-        zIndexRootElementMap.swap(newZIndexRootElementMap);
-    }
+        range.x0 = std::max(0, left) / gridCellSize;
+        range.y0 = std::max(0, bottom) / gridCellSize;
+        range.x1 = std::min(gridColumns - 1, right / gridCellSize);
+        range.y1 = std::min(gridRows - 1, top / gridCellSize);
 
-    GUIElement* GUIHandler::getActiveElement()
-    {
-        return activeElement;
-    }
-    
-    // TODO: Use dynamic cast to make changes when an activeElement
-    // of certain type is swapped out, e.g. beingEdited for edit text
-    void GUIHandler::setActiveElement(GUIElement* element)
-    {
-        activeElement = element;
+        return range;
     }
 
-    bool GUIHandler::isOrContainsActiveElement(GUIElement* element)
-    {   
-        if (activeElement == element)
+    bool GUIHandler::markElementsAt(int x, int y)
+    {
+        if (x < 0 || y < 0 || x >= (int)windowWidth || y >= (int)windowHeight)
         {
-            return true;
+            return false;
         }
 
-        for (auto& child : element->getChildren())
+        int column = std::min(gridColumns - 1, x / gridCellSize);
+        int row = std::min(gridRows - 1, y / gridCellSize);
+
+        bool found = false;
+        for (uint32_t slot : gridCells[row * gridColumns + column])
         {
-            if (isOrContainsActiveElement(child))
+            const SDL_Rect& hitRect = elementBounds[slot].hitRect;
+            if (x >= hitRect.x && x <= hitRect.x + hitRect.w && y >= hitRect.y && y <= hitRect.y + hitRect.h)
             {
-                return true;
+                markElementAndAncestors(slot);
+                found = true;
             }
         }
 
-        return false;
+        return found;
+    }
+
+    void GUIHandler::markElementAndAncestors(uint32_t slot)
+    {
+        // Ancestors of an already marked element are marked too
+        while (slot != GUILayoutPool::NONE && layout.inputStamp[slot] != inputStamp)
+        {
+            layout.inputStamp[slot] = inputStamp;
+            if (layout.parent[slot] == GUILayoutPool::NONE)
+            {
+                candidateRoots.emplace_back(layout.elements[slot]);
+            }
+            slot = layout.parent[slot];
+        }
     }
 
     GUIElement::GUIElement(GUIHandler* handler, int xPos, int yPos, int width, int height, bool isMovable, bool isResizable, bool isVisible, bool takesInput, int borderWidth, int cornerRadius, glm::vec4 color)
-        : handler(handler), xPos(xPos), yPos(yPos), width(width), height(height), isMovable(isMovable), isResizable(isResizable), isVisible(isVisible), takesInput(takesInput), borderWidth(borderWidth), cornerRadius(cornerRadius), color(color)
+        : handler(handler), isMovable(isMovable), isResizable(isResizable), takesInput(takesInput), borderWidth(borderWidth), cornerRadius(cornerRadius)
     {
         if (handler == nullptr)
         {
@@ -193,26 +1074,38 @@ namespace gui
             return;
         }
 
-        int zIndex = 0;
-        if (!handler->getZIndexRootElementMap().empty())
-        {
-            zIndex = std::prev(handler->getZIndexRootElementMap().end())->first + 1;
-        }
-        handler->addElement(this, zIndex);
+        handle = handler->getLayout().create(this, xPos, yPos, width, height, isVisible, color);
+        handler->addElement(this); // New elements start out on top
+        handler->updateElementBounds(handle.index);
     }
 
     GUIElement::~GUIElement()
     {
-        // OpenGL clean-up
-        glDeleteProgram(shaderProgram);
-        glDeleteVertexArrays(1, &VAO);
-        glDeleteBuffers(1, &VBO);
-        glDeleteBuffers(1, &EBO);
+        // The program and unit quad are shared through the handler, subtypes with their own buffers delete them themselves
+        if (handler == nullptr)
+        {
+            return;
+        }
+
+        // Each child unlinks itself from this element when deleted
+        GUILayoutPool& layout = handler->getLayout();
+        while (layout.firstChild[handle.index] != GUILayoutPool::NONE)
+        {
+            delete layout.elements[layout.firstChild[handle.index]];
+        }
 
-        for (auto& child : children) 
+        handler->removeElementBounds(handle.index);
+        handler->setAnimating(this, false);
+        if (handler->getActiveElement() == this)
+        {
+            handler->setActiveElement(nullptr);
+        }
+        if (layout.parent[handle.index] == GUILayoutPool::NONE)
         {
-            delete child;
+            handler->removeElement(this);
         }
+
+        layout.destroy(handle);
     }
 
     void GUIElement::addChild(GUIElement* child)
@@ -226,22 +1119,29 @@ namespace gui
         // Remove child from parent handler rootElements since it is no longer a root
         handler->removeElement(child);
 
-        children.emplace(child);
-        child->xPos += xPos; // Offset child x in relation to parent (this)
-        child->yPos += yPos; // Offset child y in relation to parent (this)
+        // Offset child in relation to parent (this), along with any children it already has, which
+        // are positioned in relation to child and would otherwise be left behind
+        GUILayoutPool& layout = handler->getLayout();
+        layout.appendChild(handle.index, child->handle.index);
+        int xOffset = xPos(), yOffset = yPos();
+        for (uint32_t slot = child->handle.index; slot != GUILayoutPool::NONE; slot = layout.nextInSubtree(slot, child->handle.index))
+        {
+            layout.xPos[slot] += xOffset;
+            layout.yPos[slot] += yOffset;
+            handler->updateElementBounds(slot);
+        }
+        child->invalidate(); // Now drawn as part of this, even if the offset was 0
     }
 
     void GUIElement::removeChild(GUIElement* child)
     {
-        auto it = std::find(children.begin(), children.end(), child);
-        if(it == children.end())
+        if (handler->getLayout().parent[child->handle.index] != handle.index)
         {
             std::cerr << "Child not a member of children, unable to remove from children" << std::endl;
             return;
         }
 
-        children.erase(it);
-        delete child;
+        delete child; // Unlinks itself from this element
     }
 
     bool GUIElement::render() const
@@ -250,19 +1150,19 @@ namespace gui
 
         // Set up the model, view, and projection matrices
         glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(xPos, yPos, 0.0f)); // Translate ui element
-        model = glm::scale(model, glm::vec3(width, height, 1.0f)); // Scale ui element
-        glm::mat4 projection = glm::ortho(0.0f, handler->getWindowWidth(), 0.0f, handler->getWindowHeight());
+        model = glm::translate(model, glm::vec3(xPos(), yPos(), 0.0f)); // Translate ui element
+        model = glm::scale(model, glm::vec3(width(), height(), 1.0f)); // Scale ui element
 
-        // Pass the variables to the shader
+        // Pass the variables to the shader, the projection comes from the FrameConstants block
         glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-        glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
-        glUniform4fv(colorLoc, 1, glm::value_ptr(color));
-        glUniform1f(timeLoc, (GLfloat)SDL_GetTicks() / 1000.0f); // In seconds
+        glUniform4fv(colorLoc, 1, glm::value_ptr(color()));
 
-        // TODO: These don't need to be passed on every render call
-        glUniform2f(resolutionLoc, (GLfloat)width, (GLfloat)height);
-        glUniform1f(cornerRadiusLoc, (GLfloat)cornerRadius);
+        // The program is shared, so these are skipped only when the previous element drawn had the same values
+        if (handler->recordElementUniforms(shaderProgram, width(), height(), cornerRadius))
+        {
+            glUniform2f(resolutionLoc, (GLfloat)width(), (GLfloat)height());
+            glUniform1f(cornerRadiusLoc, (GLfloat)cornerRadius);
+        }
 
         // Bind the VAO
         glBindVertexArray(VAO);
@@ -289,12 +1189,13 @@ namespace gui
 
     bool GUIElement::renderChildren() const
     {
-        for (auto& child : children)
+        const GUILayoutPool& layout = handler->getLayout();
+        for (uint32_t child = layout.firstChild[handle.index]; child != GUILayoutPool::NONE; child = layout.nextSibling[child])
         {
             // TODO: This will effectively make any children of this element invisible too if this element is invisible, is this desired?
-            if (isVisible)
+            if (isVisible())
             {
-                if (!child->render())
+                if (!layout.elements[child]->render())
                 {
                     std::cerr << "Issue rendering individual GUIElement when rendering children" << std::endl;
                     return false;
@@ -320,11 +1221,13 @@ namespace gui
         if (isResizable && resize(event, inputState))
         {
             onResize();
+            handler->updateElementBounds(handle.index);
             return true;
         }
 
         if (isMovable && move(event, inputState))
         {
+            handler->updateElementBounds(handle.index);
             return true;
         }
 
@@ -338,9 +1241,15 @@ namespace gui
 
     bool GUIElement::receiveInputChildren(const SDL_Event* event, InputState* inputState)
     {
-        for (auto& child : children)
+        const GUILayoutPool& layout = handler->getLayout();
+        for (uint32_t child = layout.firstChild[handle.index]; child != GUILayoutPool::NONE; child = layout.nextSibling[child])
         {
-            if (child->receiveInput(event, inputState))
+            if (!handler->isInputCandidate(child))
+            {
+                continue;
+            }
+
+            if (layout.elements[child]->receiveInput(event, inputState))
             {
                 return true; // Event consumed, stop propagation
             }
@@ -351,7 +1260,7 @@ namespace gui
 
     bool GUIElement::isOnElement(int x, int y)
     {
-        if (x >= xPos && x <= (xPos + width) && y >= yPos && y <= (yPos + height))
+        if (x >= xPos() && x <= (xPos() + width()) && y >= yPos() && y <= (yPos() + height()))
         {
             return true;
         }
@@ -368,20 +1277,20 @@ namespace gui
         switch (cornerNbr)
         {
         case 1:
-            centerX = xPos;
-            centerY = yPos + height;
+            centerX = xPos();
+            centerY = yPos() + height();
             break;
         case 2:
-            centerX = xPos + width;
-            centerY = yPos + height;
+            centerX = xPos() + width();
+            centerY = yPos() + height();
             break;
         case 3:
-            centerX = xPos;
-            centerY = yPos;
+            centerX = xPos();
+            centerY = yPos();
             break;
         case 4:
-            centerX = xPos + width;
-            centerY = yPos;
+            centerX = xPos() + width();
+            centerY = yPos();
             break;
         default:
             std::cerr << "Passed integer not in range 1-4 to isOnCorner, returning false" << std::endl;
@@ -418,19 +1327,41 @@ namespace gui
         return false;
     }
 
-    std::unordered_set<GUIElement*> GUIElement::getChildren()
+    GUIHandle GUIElement::getHandle() const
+    {
+        return handle;
+    }
+
+    std::vector<GUIElement*> GUIElement::getChildren()
     {
+        std::vector<GUIElement*> children;
+        const GUILayoutPool& layout = handler->getLayout();
+        for (uint32_t child = layout.firstChild[handle.index]; child != GUILayoutPool::NONE; child = layout.nextSibling[child])
+        {
+            children.emplace_back(layout.elements[child]);
+        }
+
         return children;
     }
 
+    GUIElement* GUIElement::getZPrev() const
+    {
+        return zPrev;
+    }
+
+    GUIElement* GUIElement::getZNext() const
+    {
+        return zNext;
+    }
+
     int GUIElement::getXPos()
     {
-        return xPos;
+        return xPos();
     }
 
     int GUIElement::getYPos()
     {
-        return yPos;
+        return yPos();
     }
 
     bool GUIElement::getIsMovable()
@@ -440,7 +1371,7 @@ namespace gui
 
     bool GUIElement::getIsVisible()
     {
-        return isVisible;
+        return isVisible();
     }
 
     bool GUIElement::getTakesInput()
@@ -470,7 +1401,7 @@ namespace gui
 
     bool GUIElement::initializeShaders()
     {
-        shaderProgram = shaders::createShaderProgram(getVertexShader(), getFragmentShader());
+        shaderProgram = handler->getSharedProgram(getVertexShader(), getFragmentShader());
         if (shaderProgram == 0)
         {
             return false;
@@ -478,11 +1409,8 @@ namespace gui
 
         // Get uniform locations
         modelLoc = glGetUniformLocation(shaderProgram, "model");
-        viewLoc = glGetUniformLocation(shaderProgram, "view");
-        projectionLoc = glGetUniformLocation(shaderProgram, "projection");
         useTextureLoc = glGetUniformLocation(shaderProgram, "useTexture");
         colorLoc = glGetUniformLocation(shaderProgram, "color");
-        timeLoc = glGetUniformLocation(shaderProgram, "time");
         resolutionLoc = glGetUniformLocation(shaderProgram, "resolution");
         cornerRadiusLoc = glGetUniformLocation(shaderProgram, "cornerRadius");
 
@@ -491,37 +1419,7 @@ namespace gui
 
     bool GUIElement::initializeBuffers()
     {
-        // Define 1x1 square with bottom-left square corner at origin
-        float vertices[] = {
-            0.0f, 0.0f, 0.0f,
-            1.0f, 0.0f, 0.0f,
-            1.0f, 1.0f, 0.0f,
-            0.0f, 1.0f, 0.0f
-        };
-
-        // Define the square's indices
-        unsigned int indices[] = {
-            0, 1, 2,
-            2, 3, 0
-        };
-
-        glGenVertexArrays(1, &VAO);
-        glBindVertexArray(VAO);
-
-        glGenBuffers(1, &VBO);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-        glGenBuffers(1, &EBO);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-
-        // Set the vertex attributes pointers
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0);
-
-        // Unbind the VAO
-        glBindVertexArray(0);
+        VAO = handler->getUnitQuadVAO();
 
         // Check for OpenGL errors
         GLenum error = glGetError();
@@ -536,6 +1434,18 @@ namespace gui
 
     void GUIElement::onResize() {}
 
+    void GUIElement::updateAnimation() {}
+
+    std::chrono::steady_clock::time_point GUIElement::getNextAnimationTime() const
+    {
+        return std::chrono::steady_clock::now();
+    }
+
+    void GUIElement::invalidate()
+    {
+        handler->markDirty(xPos(), yPos(), width(), height());
+    }
+
     bool GUIElement::resize(const SDL_Event* event, InputState* inputState)
     {
         switch (event->type)
@@ -589,11 +1499,11 @@ namespace gui
                 switch (cornerNbrBeingResized)
                 {
                 case 1: // Top Left
-                    if(width - xOffset >= 2 * borderWidth && height + yOffset >= 2 * borderWidth)
+                    if(width() - xOffset >= 2 * borderWidth && height() + yOffset >= 2 * borderWidth)
                     {
-                        xPos += xOffset;
-                        width -= xOffset;
-                        height += yOffset;
+                        xPos() += xOffset;
+                        width() -= xOffset;
+                        height() += yOffset;
                         offsetChildren(xOffset, 0); // xPos/yPos
                         resizeChildren(-xOffset, yOffset); // Width/height
                         return true;
@@ -601,10 +1511,10 @@ namespace gui
                     break;
 
                 case 2: // Top Right
-                    if(width + xOffset >= 2 * borderWidth && height + yOffset >= 2 * borderWidth)
+                    if(width() + xOffset >= 2 * borderWidth && height() + yOffset >= 2 * borderWidth)
                     {
-                        width += xOffset;
-                        height += yOffset;
+                        width() += xOffset;
+                        height() += yOffset;
                         // offsetChildren(0, 0);
                         resizeChildren(xOffset, yOffset);
                         return true;
@@ -612,12 +1522,12 @@ namespace gui
                     break;
 
                 case 3: // Bottom Left
-                    if(width - xOffset >= 2 * borderWidth && height - yOffset >= 2 * borderWidth)
+                    if(width() - xOffset >= 2 * borderWidth && height() - yOffset >= 2 * borderWidth)
                     {
-                        xPos += xOffset;
-                        yPos += yOffset;
-                        width -= xOffset;
-                        height -= yOffset;
+                        xPos() += xOffset;
+                        yPos() += yOffset;
+                        width() -= xOffset;
+                        height() -= yOffset;
                         offsetChildren(xOffset, -yOffset);
                         resizeChildren(-xOffset, -yOffset);
                         return true;
@@ -625,11 +1535,11 @@ namespace gui
                     break;
 
                 case 4: // Bottom Right
-                    if(width + xOffset >= 2 * borderWidth && height - yOffset >= 2 * borderWidth)
+                    if(width() + xOffset >= 2 * borderWidth && height() - yOffset >= 2 * borderWidth)
                     {
-                        yPos += yOffset;
-                        width += xOffset;
-                        height -= yOffset;
+                        yPos() += yOffset;
+                        width() += xOffset;
+                        height() -= yOffset;
                         offsetChildren(0, -yOffset);
                         resizeChildren(xOffset, -yOffset);
                         return true;
@@ -654,10 +1564,12 @@ namespace gui
     {
         int minSize = 0;
 
-        for (auto& child : children)
+        GUILayoutPool& layout = handler->getLayout();
+        for (uint32_t childSlot = layout.firstChild[handle.index]; childSlot != GUILayoutPool::NONE; childSlot = layout.nextSibling[childSlot])
         {
-            int newWidth = child->width + xOffset;
-            int newHeight = child->height + yOffset;
+            GUIElement* child = layout.elements[childSlot];
+            int newWidth = child->width() + xOffset;
+            int newHeight = child->height() + yOffset;
 
             // Handle newWidth
             if (newWidth < minSize)
@@ -701,8 +1613,9 @@ namespace gui
                 }
             }
 
-            child->width = newWidth;
-            child->height = newHeight;
+            child->width() = newWidth;
+            child->height() = newHeight;
+            handler->updateElementBounds(childSlot);
 
             child->resizeChildren(xOffset, yOffset);
 
@@ -760,8 +1673,8 @@ namespace gui
                 int xOffset = event->motion.xrel;
                 int yOffset = event->motion.yrel;
 
-                xPos += xOffset;
-                yPos -= yOffset;
+                xPos() += xOffset;
+                yPos() -= yOffset;
 
                 offsetChildren(xOffset, yOffset);
                 return true;
@@ -777,12 +1690,13 @@ namespace gui
 
     void GUIElement::offsetChildren(int xOffset, int yOffset)
     {
-        for (auto& child : children)
+        // Straight walk over the layout pool, no virtual behavior is involved in moving
+        GUILayoutPool& layout = handler->getLayout();
+        for (uint32_t slot = layout.nextInSubtree(handle.index, handle.index); slot != GUILayoutPool::NONE; slot = layout.nextInSubtree(slot, handle.index))
         {
-            child->xPos += xOffset;
-            child->yPos -= yOffset;
-
-            child->offsetChildren(xOffset, yOffset);
+            layout.xPos[slot] += xOffset;
+            layout.yPos[slot] -= yOffset;
+            handler->updateElementBounds(slot);
         }
     }
 
@@ -807,7 +1721,7 @@ namespace gui
             {
                 int mouseX = event->button.x;
                 int mouseY = (int)handler->getWindowHeight() - event->button.y; // Conversion from top-left to bottom-left system
-                if (mouseX >= xPos && mouseX < xPos + width && mouseY >= yPos && mouseY < yPos + height) 
+                if (mouseX >= xPos() && mouseX < xPos() + width() && mouseY >= yPos() && mouseY < yPos() + height()) 
                 {
                     onClick(this);
                     return true;
@@ -830,77 +1744,78 @@ namespace gui
         float g = distribution(rng);
         float b = distribution(rng);
 
-        button->color = glm::vec4(r, g, b, 1.0f);
+        button->color() = glm::vec4(r, g, b, 1.0f);
+        button->invalidate();
     }
 
     void GUIButton::quitApplication(GUIButton* button)
     {
-        button->handler->publish(new event::QuitEvent());
+        button->handler->publish(event::QuitEvent());
     }
 
     void GUIButton::nextModel(GUIButton* button)
     {
-        button->handler->publish(new event::NextModelEvent());
+        button->handler->publish(event::NextModelEvent());
     }
 
     void GUIButton::nextCubemap(GUIButton* button)
     {
-        button->handler->publish(new event::NextCubemapEvent());
+        button->handler->publish(event::NextCubemapEvent());
     }
 
     static float azimuthDelta = 0.1f;
     void GUIButton::lightAzimuthUp(GUIButton* button)
     {
-        button->handler->publish(new event::LightAzimuthChangeEvent(azimuthDelta));
+        button->handler->publish(event::LightAzimuthChangeEvent(azimuthDelta));
     }
 
     void GUIButton::lightAzimuthDown(GUIButton* button)
     {
-        button->handler->publish(new event::LightAzimuthChangeEvent(-azimuthDelta));
+        button->handler->publish(event::LightAzimuthChangeEvent(-azimuthDelta));
     }
 
     static float inclineDelta = (float)M_PI_4;
     void GUIButton::lightInclineUp(GUIButton* button)
     {
-        button->handler->publish(new event::LightInclineChangeEvent(inclineDelta));
+        button->handler->publish(event::LightInclineChangeEvent(inclineDelta));
     }
 
     void GUIButton::lightInclineDown(GUIButton* button)
     {
-        button->handler->publish(new event::LightInclineChangeEvent(-inclineDelta));
+        button->handler->publish(event::LightInclineChangeEvent(-inclineDelta));
     }
 
     static float luminanceDelta = (float)M_PI_4;
     void GUIButton::luminanceUp(GUIButton* button)
     {
-        button->handler->publish(new event::LuminanceChangeEvent(luminanceDelta));
+        button->handler->publish(event::LuminanceChangeEvent(luminanceDelta));
     }
 
     void GUIButton::luminanceDown(GUIButton* button)
     {
-        button->handler->publish(new event::LuminanceChangeEvent(-luminanceDelta));
+        button->handler->publish(event::LuminanceChangeEvent(-luminanceDelta));
     }
 
     static float scaleDelta = 1.0f;
     void GUIButton::scaleUp(GUIButton* button)
     {
-        button->handler->publish(new event::ScaleChangeEvent(scaleDelta));
+        button->handler->publish(event::ScaleChangeEvent(scaleDelta));
     }
 
     void GUIButton::scaleDown(GUIButton* button)
     {
-        button->handler->publish(new event::ScaleChangeEvent(-scaleDelta));
+        button->handler->publish(event::ScaleChangeEvent(-scaleDelta));
     }
 
     static float cameraSpeedFactor = 5.0f;
     void GUIButton::cameraSpeedUp(GUIButton* button)
     {
-        button->handler->publish(new event::CameraSpeedChangeEvent(cameraSpeedFactor));
+        button->handler->publish(event::CameraSpeedChangeEvent(cameraSpeedFactor));
     }
 
     void GUIButton::cameraSpeedDown(GUIButton* button)
     {
-        button->handler->publish(new event::CameraSpeedChangeEvent(1/cameraSpeedFactor));
+        button->handler->publish(event::CameraSpeedChangeEvent(1/cameraSpeedFactor));
     } 
 
     GUIText::GUIText(GUIHandler* handler, int xPos, int yPos, int width, int height, bool isMovable, bool isResizable, bool isVisible, bool takesInput, int borderWidth, int cornerRadius, glm::vec4 color,
@@ -928,7 +1843,7 @@ namespace gui
             std::cout << "Warning: GUIText created with negative padding, possibility of text ending up outside of GUIElement, thus not being rendered" << std::endl;
         }
 
-        characters = text::createText(text, font);
+        text::createText(text, font, characters);
 
         if (!initFontTextures())
         {
@@ -937,25 +1852,16 @@ namespace gui
     }
 
     // TODO: Do something with Font pointer?
+    // Font textures are shared through GUIFontAtlas and outlive the GUIText
     GUIText::~GUIText() 
     {
-        for (auto& pair : fontTextures)
-        {
-            for (GLuint textureID : pair.second)
-            {
-                glDeleteTextures(1, &textureID);
-            }
-        }
-
-        // OpenGL cleanup
+        // OpenGL cleanup, the program is shared
         cleanupBuffers();
-
-        glDeleteProgram(shaderProgram);
     }
 
     void GUIText::onResize()
     {
-        cleanupBuffers();
+        // Buffers are kept and only rewritten, see reserveGlyphBuffers
         initializeBuffers();
     }
 
@@ -971,14 +1877,13 @@ namespace gui
 
     bool GUIText::initializeShaders()
     {
-        shaderProgram = shaders::createShaderProgram(getVertexShader(), getFragmentShader());
+        shaderProgram = handler->getSharedProgram(getVertexShader(), getFragmentShader());
         if (shaderProgram == 0)
         {
             return false;
         }
 
         // Get uniform locations necessary for GUIText rendering
-        projectionLoc = glGetUniformLocation(shaderProgram, "projection");
         modelLoc = glGetUniformLocation(shaderProgram, "model");
         textLoc = glGetUniformLocation(shaderProgram, "text");
         textColorLoc = glGetUniformLocation(shaderProgram, "textColor");
@@ -986,59 +1891,87 @@ namespace gui
         return true;
     }
 
-    // Cursor from x,y = 0 (or padding), pass cursors for each character to calculateVertices
+    // Cursor from x,y = 0 (or padding), each line writes its glyph quads straight into the mapped VBO
     bool GUIText::initializeBuffers()
     {
+        // Lines from the previous layout are released all at once
+        layoutArena.reset();
+
         totalWidth = 0, totalHeight = 0;
-        lines = text::createLines(characters, &totalWidth, &totalHeight);
+        lines = text::createLines(characters, layoutArena, &totalWidth, &totalHeight);
 
-        float scaleX = (width - padding * 2) / totalWidth;
-        float scaleY = (height - padding * 2) / totalHeight;
+        float scaleX = (width() - padding * 2) / totalWidth;
+        float scaleY = (height() - padding * 2) / totalHeight;
 
         if (autoScaleText)
         {
             textScale = std::min(scaleX, scaleY);
         }
 
-        float xCursor = (float)padding, yCursor = -(float)padding; // Initialize x and y to the starting position of the text
-        // For each line, traverse characters and calculate vertices
-        for (size_t i = 0; i < lines.size(); ++i)
+        size_t newGlyphCount = 0;
+        for (const text::Line& line : lines)
         {
-            xCursor = (float)padding;
-            lines[i]->startX = xCursor;
-            for (const auto& ch : lines[i]->characters)
-            {
-                std::vector<float> vertices = calculateVertices(ch, xCursor, yCursor);
-
-                // Create a VAO for this character
-                GLuint VAO;
-                glGenVertexArrays(1, &VAO);
-                glBindVertexArray(VAO);
-
-                // Create a VBO for this character
-                GLuint VBO;
-                glGenBuffers(1, &VBO);
-                glBindBuffer(GL_ARRAY_BUFFER, VBO);
-                glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+            newGlyphCount += line.characters.size();
+        }
 
-                // Set up the vertex attributes
-                glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
-                glEnableVertexAttribArray(0);
+        if (!reserveGlyphBuffers(newGlyphCount))
+        {
+            return false;
+        }
+        glyphCount = newGlyphCount;
 
-                characterVAOs.emplace_back(VAO);
+        // Group consecutive glyphs by texture array so that render only rebinds between runs
+        glyphRuns.clear();
+        size_t glyphIx = 0;
+        for (const text::Line& line : lines)
+        {
+            for (text::Character* ch : line.characters)
+            {
+                const GUIFontAtlas::ArrayGroup* group = GUIFontAtlas::getInstance()->getGroup(ch->font);
+                if (glyphRuns.empty() || glyphRuns.back().group != group)
+                {
+                    glyphRuns.push_back({ group, glyphIx, 0 });
+                }
+                ++glyphRuns.back().glyphCount;
+                ++glyphIx;
+            }
+        }
 
-                // Clean up
+        float* vertices = nullptr;
+        if (glyphCount > 0)
+        {
+            // Invalidating lets the driver hand out fresh memory instead of waiting on draws still using the old quads
+            glBindBuffer(GL_ARRAY_BUFFER, VBO);
+            vertices = (float*)glMapBufferRange(GL_ARRAY_BUFFER, 0, glyphCount * text::GLYPH_QUAD_FLOATS * sizeof(float), 
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            if (vertices == nullptr)
+            {
+                std::cerr << "Failed to map GUIText vertex buffer" << std::endl;
                 glBindBuffer(GL_ARRAY_BUFFER, 0);
-                glBindVertexArray(0);
-
-                // Advance cursor for next glyph
-                xCursor += ch->advance * ch->font->getSize() * textScale;
+                return false;
             }
+        }
 
-            lines[i]->endX = xCursor;
-            lines[i]->yPosition = yCursor;
+        float yCursor = -(float)padding; // Initialize y to the starting position of the text
+        for (size_t i = 0; i < lines.size(); ++i)
+        {
+            lines[i].startX = (float)padding;
+            lines[i].endX = text::writeLineVertices(lines[i], lines[i].startX, yCursor, textScale, vertices);
+            lines[i].yPosition = yCursor;
+
+            vertices += lines[i].characters.size() * text::GLYPH_QUAD_FLOATS;
+            yCursor -= lines[i].height * textScale;
+        }
 
-            yCursor -= lines[i]->height * textScale;
+        if (glyphCount > 0)
+        {
+            GLboolean unmapped = glUnmapBuffer(GL_ARRAY_BUFFER);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            if (unmapped == GL_FALSE)
+            {
+                std::cerr << "GUIText vertex buffer was corrupted while mapped" << std::endl;
+                return false;
+            }
         }
 
         // Check for OpenGL errors
@@ -1049,6 +1982,8 @@ namespace gui
             return false;
         }
 
+        invalidate();
+
         return true;
     }
 
@@ -1056,58 +1991,54 @@ namespace gui
     {
         glUseProgram(shaderProgram);
 
-        // Set the scissor rectangle to the bounding box of the GUIElement
+        // Set the scissor rectangle to the bounding box of the GUIElement, within the region being redrawn
         glEnable(GL_SCISSOR_TEST);
-        glScissor(xPos, yPos, width, height);
-
-        glm::mat4 projection = glm::ortho(0.0f, handler->getWindowWidth(), 0.0f, handler->getWindowHeight());
-        glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
+        handler->setScissor(xPos(), yPos(), width(), height());
 
         glUniform1i(textLoc, 0);
-        glUniform4fv(textColorLoc, 1, glm::value_ptr(color));
+        glUniform4fv(textColorLoc, 1, glm::value_ptr(color()));
     }
 
     void GUIText::finishTextRendering() const
     {
-        glDisable(GL_SCISSOR_TEST);
+        handler->resetScissor();
 
         // Clean up
         glBindVertexArray(0);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
     }
 
     bool GUIText::render() const
     {
         prepareTextRendering();
 
-        int charVAOIx = -1;
-        float yLineOffset = height - lines[0]->maxAscender * textScale;
-        // Bind the VAO and texture for each character and draw it
-        for (size_t i = 0; i < lines.size(); ++i)
+        // Every glyph quad is already positioned relative to the GUIText, so one model matrix covers them all
+        float yLineOffset = height() - lines[0].maxAscender * textScale;
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::translate(model, glm::vec3(xPos(), yPos() + yLineOffset, 0.0f));
+        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+
+        glBindVertexArray(VAO);
+        for (const GlyphRun& run : glyphRuns)
         {
-            for (size_t j = 0; j < lines[i]->characters.size(); j++)
+            if (run.group != nullptr)
             {
-                ++charVAOIx;
-                text::Character* ch = lines[i]->characters[j];
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D_ARRAY, run.group->textureID);
+            }
 
-                if (!shouldRenderCharacter(charVAOIx))
+            // Glyphs that should not be rendered split the run into separate draws
+            size_t drawStart = run.firstGlyph;
+            size_t runEnd = run.firstGlyph + run.glyphCount;
+            for (size_t glyphIx = run.firstGlyph; glyphIx < runEnd; ++glyphIx)
+            {
+                if (!shouldRenderCharacter(glyphIx))
                 {
-                    continue;
+                    drawGlyphs(drawStart, glyphIx - drawStart);
+                    drawStart = glyphIx + 1;
                 }
-
-                // Bind the texture for this character
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, fontTextures.at(ch->font).at(0));
-
-                // Create the model matrix for this character
-                glm::mat4 model = glm::mat4(1.0f);
-                model = glm::translate(model, glm::vec3(xPos, yPos + yLineOffset, 0.0f));
-                glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-                // Bind the VAO for this character and draw it
-                glBindVertexArray(characterVAOs[charVAOIx]);
-                glDrawArrays(GL_TRIANGLES, 0, 6);
             }
+            drawGlyphs(drawStart, runEnd - drawStart);
         }
 
         finishTextRendering();
@@ -1128,14 +2059,17 @@ namespace gui
 
     void GUIText::cleanupBuffers()
     {
-        for (GLuint VAO : characterVAOs)
-        {
-            glDeleteVertexArrays(1, &VAO);
-        }
-        characterVAOs.clear();
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        VAO = 0, VBO = 0, EBO = 0;
+
+        glyphRuns.clear();
+        glyphCount = 0;
+        glyphCapacity = 0;
     }
 
-    bool GUIText::shouldRenderCharacter(int charVAOIx) const
+    bool GUIText::shouldRenderCharacter(size_t glyphIx) const
     {
         return true;
     }
@@ -1160,54 +2094,83 @@ namespace gui
 
         for (text::Font* font : fonts) 
         {
-            std::vector<GLuint> textureIDs;
-            for (const auto& texturePath : font->getPngPaths()) 
+            // Fonts already loaded by other GUIText elements are reused
+            if (GUIFontAtlas::getInstance()->acquireFont(font) == nullptr)
             {
-                // Load the texture from the file and store the texture ID
-                GLuint textureID = texturel::loadFontTexture(texturePath);
-                if (textureID == 0)
-                {
-                    std::cerr << "Failed to load texture from: " << texturePath << std::endl;
-                    return false;
-                }
-
-                textureIDs.push_back(textureID);
+                std::cerr << "Failed to load atlas textures for font: " << font->getFontName() << std::endl;
+                return false;
             }
-
-            fontTextures[font] = textureIDs;
         }
 
         return true;
     }
 
-    std::vector<float> GUIText::calculateVertices(text::Character* ch, float x, float y)
+    bool GUIText::reserveGlyphBuffers(size_t count)
     {
-        float fontSize = ch->font->getSize();
+        if (VAO == 0)
+        {
+            glGenVertexArrays(1, &VAO);
+            glGenBuffers(1, &VBO);
+            glGenBuffers(1, &EBO);
 
-        // Compute the absolute pixel bounds of the glyph
-        float x1 = x + ch->planeLeft * fontSize * textScale;
-        float y1 = y + ch->planeBottom * fontSize * textScale;
-        float x2 = x + ch->planeRight * fontSize * textScale;
-        float y2 = y + ch->planeTop * fontSize * textScale;
+            glBindVertexArray(VAO);
+            glBindBuffer(GL_ARRAY_BUFFER, VBO);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
 
-        // Compute the texture coordinates of the glyph
-        float u1 = ch->atlasLeft / ch->font->getTextureWidth();
-        float v1 = ch->atlasBottom / ch->font->getTextureHeight();
-        float u2 = ch->atlasRight / ch->font->getTextureWidth();
-        float v2 = ch->atlasTop / ch->font->getTextureHeight();
+            // Set up the vertex attributes, <vec2 pos, vec2 tex> followed by the atlas layer
+            glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, text::GLYPH_VERTEX_FLOATS * sizeof(float), (void*)0);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, text::GLYPH_VERTEX_FLOATS * sizeof(float), (void*)(4 * sizeof(float)));
+            glEnableVertexAttribArray(1);
 
-        std::vector<float> retVec = {
-            // Triangle 1
-            x1, y1, u1, v1,
-            x2, y1, u2, v1,
-            x1, y2, u1, v2,
-            // Triangle 2
-            x1, y2, u1, v2,
-            x2, y1, u2, v1,
-            x2, y2, u2, v2
-        };
+            glBindVertexArray(0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+
+        if (count <= glyphCapacity)
+        {
+            return true;
+        }
+
+        // Grow geometrically so that typing into a GUIEditText does not reallocate on every keystroke
+        glyphCapacity = std::max(count, glyphCapacity * 2);
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, glyphCapacity * text::GLYPH_QUAD_FLOATS * sizeof(float), nullptr, GL_DYNAMIC_DRAW);
+
+        // The index pattern is the same for every layout, so it is only written when the buffer grows
+        GLsizeiptr indicesSize = glyphCapacity * text::GLYPH_QUAD_INDICES * sizeof(GLuint);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indicesSize, nullptr, GL_STATIC_DRAW);
+        GLuint* indices = (GLuint*)glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, indicesSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (indices != nullptr)
+        {
+            text::writeQuadIndices(glyphCapacity, indices);
+            glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+        }
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        if (indices == nullptr)
+        {
+            std::cerr << "Failed to map GUIText index buffer" << std::endl;
+            glyphCapacity = 0;
+            return false;
+        }
+
+        return true;
+    }
+
+    void GUIText::drawGlyphs(size_t firstGlyph, size_t count) const
+    {
+        if (count == 0)
+        {
+            return;
+        }
 
-        return retVec;
+        glDrawElements(GL_TRIANGLES, (GLsizei)(count * text::GLYPH_QUAD_INDICES), GL_UNSIGNED_INT, 
+            (void*)(firstGlyph * text::GLYPH_QUAD_INDICES * sizeof(GLuint)));
     }
 
     GUIEditText::GUIEditText(GUIHandler* handler, int xPos, int yPos, int width, int height, bool isMovable, bool isResizable, bool isVisible, int borderWidth, int cornerRadius, glm::vec4 color,
@@ -1322,47 +2285,61 @@ namespace gui
 
     void GUIEditText::setBeingEdited(bool beingEdited)
     {
+        if (this->beingEdited == beingEdited)
+        {
+            return;
+        }
         this->beingEdited = beingEdited;
+
+        // Ensure that the last character starts out visible, and stays visible when not beingEdited
+        lastCharacterVisible = true;
+        lastBlinkTime = std::chrono::steady_clock::now();
+        handler->setAnimating(this, beingEdited);
+        invalidate();
     }
 
-    bool GUIEditText::shouldRenderCharacter(int charVAOIx) const
+    bool GUIEditText::shouldRenderCharacter(size_t glyphIx) const
     {
-        auto now = std::chrono::steady_clock::now();
-        // Ensure that if not beingEdited then lastCharacterVisible is true
-        if (!beingEdited)
+        if (glyphIx == glyphCount - 1 && !lastCharacterVisible) 
         {
-            lastCharacterVisible = true;
+            return false;
         }
-        else if (beingEdited && (now - lastBlinkTime > blinkDuration))
+
+        return true;
+    }
+
+    void GUIEditText::updateAnimation()
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (beingEdited && (now - lastBlinkTime >= blinkDuration))
         {
             lastCharacterVisible = !lastCharacterVisible;
             lastBlinkTime = now;
+            invalidate();
         }
+    }
 
-        if (charVAOIx == characterVAOs.size() - 1 && !lastCharacterVisible) 
-        {
-            return false;
-        }
-
-        return true;
+    std::chrono::steady_clock::time_point GUIEditText::getNextAnimationTime() const
+    {
+        return lastBlinkTime + blinkDuration;
     }
 
     void GUIEditText::startTextInput(InputState* inputState)
     {
         handler->setActiveElement(this);
-        beingEdited = true;
+        setBeingEdited(true);
 
         inputState->setKeyboardState(InputState::KeyboardState::GUIKeyboardControl);
-        SDL_StartTextInput();
+        handler->setTextInputActive(true);
     }
 
     void GUIEditText::stopTextInput(InputState* inputState)
     {
         handler->setActiveElement(nullptr);
-        beingEdited = false;
+        setBeingEdited(false);
 
         inputState->setKeyboardState(InputState::KeyboardState::MovementControl);
-        SDL_StopTextInput();
+        handler->setTextInputActive(false);
     }
 
     bool GUIEditText::regenCharactersAndBuffers()
@@ -1372,10 +2349,9 @@ namespace gui
         lastCharacterVisible = true;
         lastBlinkTime = std::chrono::steady_clock::now();
 
-        characters = text::createText(text, font);
+        text::createText(text, font, characters);
 
-        // Regenerate Characters and buffers
-        cleanupBuffers();
+        // Regenerate Characters and rewrite the buffers in place
         return initializeBuffers();
     }
 
@@ -1401,9 +2377,9 @@ namespace gui
 
     bool GUIEditText::isOnText(int x, int y)
     {
-        for (const auto& line : lines)
+        for (auto& line : lines)
         {
-            if (isOnLine(line, x, y))
+            if (isOnLine(&line, x, y))
             {
                 return true;
             }
@@ -1415,9 +2391,9 @@ namespace gui
     // TODO: Not precise for small text, bound stretches above text into text above
     bool GUIEditText::isOnLine(text::Line* line, int x, int y)
     {
-        int startBoundX = xPos + (int)line->startX;
-        int endBoundX = xPos + (int)line->endX;
-        int topBoundY = yPos + height + (int)line->yPosition;
+        int startBoundX = xPos() + (int)line->startX;
+        int endBoundX = xPos() + (int)line->endX;
+        int topBoundY = yPos() + height() + (int)line->yPosition;
         int lowerBoundY = topBoundY - (int)(line->height * textScale);
 
         if (x >= startBoundX && x <= endBoundX && y <= topBoundY && y >= lowerBoundY)
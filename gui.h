@@ -7,7 +7,7 @@
 #include <functional>   
 #include <string>
 #include <chrono>
-#include <map>
+#include <cstdint>
 
 #include "input_state.h"
 #include "text.h"
@@ -34,6 +34,77 @@ namespace gui
         {"DARK GRAY",  glm::vec4(0.25f, 0.25f, 0.25f, 1.0f)}
     };
 
+    // Packs the atlas pages of every Font used by GUIText into GL_TEXTURE_2D_ARRAYs, one array per atlas
+    // size, so that text mixing Fonts (and pages) of the same atlas size renders from a single binding
+    class GUIFontAtlas
+    {
+    public:
+        struct ArrayGroup
+        {
+            GLuint textureID = 0;
+            int width = 0, height = 0;
+            int layerCount = 0;
+        };
+
+        ~GUIFontAtlas();
+
+        static GUIFontAtlas* getInstance();
+        // Deletes the instance and resets it, a later getInstance creates a new one
+        static void destroy();
+        static GUIFontAtlas* instance;
+
+        // Loads all atlas pages of font into the array for its atlas size unless already loaded and
+        // sets the Font's atlas layer, returns the group containing the Font or nullptr on failure
+        const ArrayGroup* acquireFont(text::Font* font);
+        const ArrayGroup* getGroup(text::Font* font) const;
+
+    private:
+        std::vector<ArrayGroup*> groups;
+        std::unordered_map<text::Font*, ArrayGroup*> fontGroups;
+    };
+
+    // Stable reference to the slot of a GUIElement in a GUILayoutPool, slots are reused
+    // with a new generation once freed, which makes stale handles detectable
+    struct GUIHandle
+    {
+        uint32_t index = UINT32_MAX;
+        uint32_t generation = 0;
+    };
+
+    // Layout state of every GUIElement of a GUIHandler in contiguous arrays indexed by slot (GUIHandle::index),
+    // children are linked in insertion order so that traversals visit them in a deterministic order
+    class GUILayoutPool
+    {
+    public:
+        static const uint32_t NONE = UINT32_MAX;
+
+        GUIHandle create(GUIElement* element, int xPos, int yPos, int width, int height, bool isVisible, glm::vec4 color);
+        // Unlinks the slot from its parent and frees it, its children must have been destroyed already
+        void destroy(GUIHandle handle);
+        bool isValid(GUIHandle handle) const;
+        GUIHandle getHandle(uint32_t slot) const;
+
+        void appendChild(uint32_t parentSlot, uint32_t childSlot);
+        void unlinkChild(uint32_t childSlot);
+        // Pre-order walk of the subtree rooted at rootSlot, excluding rootSlot itself, NONE once exhausted
+        uint32_t nextInSubtree(uint32_t slot, uint32_t rootSlot) const;
+
+        // Number of slots, including free ones
+        size_t size() const;
+
+        std::vector<int> xPos, yPos;
+        std::vector<int> width, height;
+        std::vector<uint8_t> isVisible;
+        std::vector<glm::vec4> color;
+        std::vector<uint32_t> parent, firstChild, lastChild, nextSibling, prevSibling;
+        std::vector<unsigned int> inputStamp; // Equal to the handler's inputStamp while a candidate for the current pointer event
+        std::vector<GUIElement*> elements; // nullptr for free slots
+
+    private:
+        std::vector<uint32_t> generations;
+        std::vector<uint32_t> freeSlots;
+    };
+
     enum class ElementManipulationState
     {
         None,
@@ -54,36 +125,154 @@ namespace gui
         float getWindowHeight() const;
         float getWindowWidth() const;
 
-        void addElement(GUIElement* element, int zIndex = 0);
+        // Adds a root element on top of all other root elements
+        void addElement(GUIElement* element);
         // Be careful about using removeElement externally, better 
         // to access indirectly through "delete element"
         void removeElement(GUIElement* element);
+        // Moves a root element to the top or bottom of the z-order
+        void raiseElement(GUIElement* element);
+        void lowerElement(GUIElement* element);
 
         void prepareGUIRendering() const;
         void finishGUIRendering() const;
 
-        bool renderAllElements() const;
-        // receiveInputAllElements has as a side effect that it updates the zIndexRootElementMap
+        // Redraws the dirty regions of the offscreen GUI texture and composites it over whatever is in the framebuffer
+        bool renderAllElements();
+        // receiveInputAllElements has as a side effect that the root element consuming the event is raised
         bool receiveInputAllElements(const SDL_Event* event, InputState* inputState);
+        // Whether any element reacts to SDL events of this type, other events need not be dispatched
+        bool handlesEventType(Uint32 type) const;
 
-        std::multimap<int, GUIElement*> getZIndexRootElementMap();
-        void GUIHandler::normalizeZIndices();
+        // Root elements from bottom to top, iterate with
+        // for (GUIElement* e = getBottomRootElement(); e != nullptr; e = e->getZNext())
+        GUIElement* getBottomRootElement() const;
+        GUIElement* getTopRootElement() const;
+        size_t getRootElementCount() const;
 
         GUIElement* getActiveElement();
         void setActiveElement(GUIElement* element);
         bool isOrContainsActiveElement(GUIElement* element);
+        // SDL text input must be started and stopped on the thread owning the window, when the GUI runs on
+        // another thread toggle hands the calls over to it. Without a toggle SDL is called directly
+        void setTextInputToggle(std::function<void(bool)> toggle);
+        void setTextInputActive(bool active);
+
+        GUILayoutPool& getLayout() { return layout; }
+        // Returns nullptr if the element of handle has been deleted
+        GUIElement* getElement(GUIHandle handle) const;
+
+        // Keeps the spatial grid in sync with the rect of the element in slot, called whenever position or size changes
+        void updateElementBounds(uint32_t slot);
+        void removeElementBounds(uint32_t slot);
+        // Whether the element in slot should see the pointer event currently being dispatched, always true for other events
+        bool isInputCandidate(uint32_t slot) const;
+
+        // Schedules the region (bottom-left window coordinates) of the offscreen GUI texture for redrawing
+        void markDirty(int x, int y, int width, int height);
+        // Scissors to the intersection of the rect and the region currently being redrawn
+        void setScissor(int x, int y, int width, int height) const;
+        // Restores the scissor to the region currently being redrawn
+        void resetScissor() const;
+        // Animating elements get updateAnimation called every frame, since they are otherwise only redrawn when dirty
+        void setAnimating(GUIElement* element, bool animating);
+        // Earliest time an animating element needs a frame, time_point::max() if no element is animating
+        std::chrono::steady_clock::time_point getNextAnimationTime() const;
+
+        // Programs are linked once per pair of shader sources and shared by all elements using them, owned by the handler
+        GLuint getSharedProgram(const GLchar* vertexShaderSource, const GLchar* fragmentShaderSource);
+        // 1x1 quad with its bottom-left corner at the origin, drawn as 6 indices, shared by all non-text elements
+        GLuint getUnitQuadVAO();
+        // Returns true if program does not hold these element uniforms yet, they are then expected to be uploaded
+        bool recordElementUniforms(GLuint program, int width, int height, int cornerRadius) const;
 
     private:
+        // Inclusive range of grid cells covered by an element, empty (x1 < x0) when fully outside the window
+        struct GridRange
+        {
+            int x0 = 0, y0 = 0;
+            int x1 = -1, y1 = -1;
+        };
+
+        bool renderElements() const;
+        // (Re)creates the offscreen GUI texture at the window size, marking all of it dirty
+        bool initializeCache();
+        void markSubtreeDirty(GUIElement* element);
+
+        void rebuildGrid();
+        GridRange getGridRange(const SDL_Rect& hitRect) const;
+        // Marks the elements whose rect (including resize corners) contains x, y along with their ancestors
+        // as input candidates, returns false if there are none
+        bool markElementsAt(int x, int y);
+        void markElementAndAncestors(uint32_t slot);
+
         float windowWidth;
         float windowHeight;
 
-        std::multimap<int, GUIElement*> zIndexRootElementMap;
+        event::EventDispatcher eventDispatcher;
+
+        GUILayoutPool layout;
+
+        // Intrusive doubly linked list of root elements through GUIElement::zPrev/zNext, the top is rendered last
+        GUIElement* bottomRootElement = nullptr;
+        GUIElement* topRootElement = nullptr;
+        size_t rootElementCount = 0;
+        long long topZOrder = 0, bottomZOrder = 0; // Last GUIElement::zOrder handed out at either end
+        std::vector<GUIElement*> candidateRoots; // Root elements marked for the pointer event being dispatched
+
         GUIElement* activeElement = nullptr;
+        std::function<void(bool)> textInputToggle;
+
+        struct ElementBounds
+        {
+            SDL_Rect rect; // Without resize corners
+            SDL_Rect hitRect; // Including resize corners, bounds are inclusive
+            GridRange range;
+            bool inGrid = false;
+        };
+
+        // Uniform grid over the window, each cell lists the slots of the elements overlapping it
+        const int gridCellSize = 64;
+        int gridColumns = 0, gridRows = 0;
+        std::vector<std::vector<uint32_t>> gridCells;
+        std::vector<ElementBounds> elementBounds; // Indexed by slot
+
+        // Offscreen GUI texture, cleared to transparent and holding premultiplied colors
+        GLuint cacheFBO = 0, cacheTexture = 0;
+        GLuint compositeProgram = 0, compositeVAO = 0;
+        GLint compositeTextureLoc;
+        int cacheWidth = 0, cacheHeight = 0;
+        bool cacheValid = false;
+        std::vector<SDL_Rect> dirtyRects;
+        const size_t maxDirtyRects = 8; // Beyond this the dirty regions are collapsed into their bounding box
+        SDL_Rect clipRect = { 0, 0, 0, 0 }; // Region currently being redrawn
+        std::unordered_set<GUIElement*> animatedElements;
+
+        unsigned int inputStamp = 0; // Incremented for every pointer dispatch, see GUILayoutPool::inputStamp
+        bool filterInput = false;
+
+        struct SharedProgram
+        {
+            const GLchar* vertexShaderSource;
+            const GLchar* fragmentShaderSource;
+            GLuint program;
+        };
+        std::vector<SharedProgram> sharedPrograms;
+        GLuint unitQuadVAO = 0, unitQuadVBO = 0, unitQuadEBO = 0;
+
+        // Uniform values of the last element drawn, uniforms are program state so they survive between draws
+        struct ElementUniforms
+        {
+            GLuint program = 0;
+            int width = -1, height = -1, cornerRadius = -1;
+        };
+        mutable ElementUniforms lastElementUniforms;
     };
 
     class GUIElement 
     {
         friend class GUIElementBuilder;
+        friend class GUIHandler;
     public:
         virtual ~GUIElement();
 
@@ -109,7 +298,12 @@ namespace gui
         // Sets cornerNbrBeingResized to the corner being resized, or 0 if none being resized
         bool isOnAnyCorner(int x, int y, int* cornerNbrBeingResized);
 
-        std::unordered_set<GUIElement*> getChildren();
+        GUIHandle getHandle() const;
+        // Children in the order they were added
+        std::vector<GUIElement*> getChildren();
+        // Neighbouring root elements in z-order, nullptr for non-root elements and at the ends
+        GUIElement* getZPrev() const;
+        GUIElement* getZNext() const;
         int getXPos();
         int getYPos();
         bool getIsMovable();
@@ -132,6 +326,12 @@ namespace gui
 
         // Override for GUIText text regeneration after resize
         virtual void onResize();
+        // Override for elements whose appearance changes over time, called every frame while registered with setAnimating
+        virtual void updateAnimation();
+        // When updateAnimation next changes the element, frames can be skipped until then, defaults to right away
+        virtual std::chrono::steady_clock::time_point getNextAnimationTime() const;
+        // Marks the area of the element for redrawing, needed after any change that is not a move or resize
+        void invalidate();
 
         // Resize and move return true if the event was consumed, false otherwise
         bool resize(const SDL_Event* event, InputState* inputState);
@@ -142,15 +342,29 @@ namespace gui
         bool move(const SDL_Event* event, InputState* inputState);
         void offsetChildren(int xOffset, int yOffset);
 
+        // Layout fields live in the handler's GUILayoutPool, parent and children are linked there too
+        int& xPos() { return handler->getLayout().xPos[handle.index]; }
+        int& yPos() { return handler->getLayout().yPos[handle.index]; }
+        int& width() { return handler->getLayout().width[handle.index]; }
+        int& height() { return handler->getLayout().height[handle.index]; }
+        uint8_t& isVisible() { return handler->getLayout().isVisible[handle.index]; }
+        glm::vec4& color() { return handler->getLayout().color[handle.index]; }
+        int xPos() const { return handler->getLayout().xPos[handle.index]; }
+        int yPos() const { return handler->getLayout().yPos[handle.index]; }
+        int width() const { return handler->getLayout().width[handle.index]; }
+        int height() const { return handler->getLayout().height[handle.index]; }
+        uint8_t isVisible() const { return handler->getLayout().isVisible[handle.index]; }
+        glm::vec4 color() const { return handler->getLayout().color[handle.index]; }
+
         GUIHandler* handler;
-        std::unordered_set<GUIElement*> children;
+        GUIHandle handle;
+        GUIElement* zPrev = nullptr;
+        GUIElement* zNext = nullptr;
+        long long zOrder = 0; // Larger is higher up, only compared between root elements
 
-        int xPos, yPos;
-        int width, height;
-        bool isMovable, isResizable, isVisible, takesInput;
+        bool isMovable, isResizable, takesInput;
         int borderWidth;
         int cornerRadius; // In pixels, TODO: Add as parameter to constructor
-        glm::vec4 color;
 
         // Manipulation management members
         ElementManipulationState manipulationStateResize = ElementManipulationState::None;
@@ -159,8 +373,8 @@ namespace gui
         int accumUnderMinSizeX = 0, accumUnderMinSizeY = 0;
 
         // Shader stuff
-        GLint modelLoc, viewLoc, projectionLoc, useTextureLoc, colorLoc, timeLoc, resolutionLoc, cornerRadiusLoc;
-        GLuint shaderProgram, VAO, VBO, EBO;
+        GLint modelLoc, useTextureLoc, colorLoc, resolutionLoc, cornerRadiusLoc;
+        GLuint shaderProgram = 0, VAO = 0, VBO = 0, EBO = 0;
     };
 
     class GUIButton : public GUIElement 
@@ -198,8 +412,6 @@ namespace gui
         std::function<void(GUIButton*)> onClick;
     };
 
-    // TODO: Different GUIText objects using the same Font will each 
-    // reload the font texture, should be able to reuse the same texture
     class GUIText : public GUIElement
     {
         friend class GUIElementBuilder;
@@ -225,26 +437,37 @@ namespace gui
         void finishTextRendering() const;
 
         void cleanupBuffers();
-        virtual bool shouldRenderCharacter(int charVAOIx) const;
+        virtual bool shouldRenderCharacter(size_t glyphIx) const;
         
         std::wstring text;
         text::Font* font; // I forgot why this is here if each Character has its own Font
         std::vector<text::Character*> characters;
-        std::unordered_map<text::Font*, std::vector<GLuint>> fontTextures;
-        std::vector<text::Line*> lines;
+        text::LayoutArena layoutArena; // Owns lines, reset on every relayout
+        text::Span<text::Line> lines;
 
         int padding;
         float textScale;
         float totalHeight, totalWidth;
         bool autoScaleText;
 
-        // Shader stuff
-        std::vector<GLuint> characterVAOs;
-        GLint projectionLoc, modelLoc, textLoc, textColorLoc;
+        // Consecutive glyphs sampling the same texture array, drawn without rebinding
+        struct GlyphRun
+        {
+            const GUIFontAtlas::ArrayGroup* group;
+            size_t firstGlyph;
+            size_t glyphCount;
+        };
+
+        // Shader stuff, all glyph quads live in the VAO, VBO and EBO inherited from GUIElement
+        std::vector<GlyphRun> glyphRuns;
+        size_t glyphCount = 0;
+        size_t glyphCapacity = 0; // Number of quads the VBO and EBO have room for
+        GLint modelLoc, textLoc, textColorLoc;
     
     private:
         bool initFontTextures();
-        std::vector<float> calculateVertices(text::Character* ch, float x, float y);
+        bool reserveGlyphBuffers(size_t count);
+        void drawGlyphs(size_t firstGlyph, size_t count) const;
     };
 
     class GUIEditText : public GUIText
@@ -262,7 +485,9 @@ namespace gui
         GUIEditText(GUIHandler* handler, int xPos, int yPos, int width, int height, bool isMovable, bool isResizable, bool isVisible, int borderWidth, int cornerRadius, glm::vec4 color,
             std::wstring text, text::Font* font, bool autoScaleText, float textScale, int padding);
 
-        bool shouldRenderCharacter(int charVAOIx) const override;
+        bool shouldRenderCharacter(size_t glyphIx) const override;
+        void updateAnimation() override;
+        std::chrono::steady_clock::time_point getNextAnimationTime() const override;
 
     private:
         void startTextInput(InputState* inputState);
@@ -276,8 +501,8 @@ namespace gui
         bool isOnCharacterInLine(text::Character* ch, text::Line* line, int x, int y);
 
         bool beingEdited = false;
-        mutable bool lastCharacterVisible = true;
-        mutable std::chrono::steady_clock::time_point lastBlinkTime = std::chrono::steady_clock::now();
+        bool lastCharacterVisible = true;
+        std::chrono::steady_clock::time_point lastBlinkTime = std::chrono::steady_clock::now();
         std::chrono::milliseconds blinkDuration = std::chrono::milliseconds(500);
     };
 
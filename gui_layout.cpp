@@ -0,0 +1,311 @@
+#include <iostream>
+#include <fstream>
+#include <locale>
+#include <codecvt>
+#include <unordered_map>
+#include <cassert>
+
+#include "json.h"
+#include "gui_layout.h"
+#include "jobs.h"
+
+namespace gui
+{
+    namespace
+    {
+        // Functions that can be named by "onClick" in a layout file
+        const std::unordered_map<std::string, void(*)(GUIButton*)> onClickFunctions = {
+            {"randomColor",      &GUIButton::randomColor},
+            {"quitApplication",  &GUIButton::quitApplication},
+            {"nextModel",        &GUIButton::nextModel},
+            {"nextCubemap",      &GUIButton::nextCubemap},
+            {"lightAzimuthUp",   &GUIButton::lightAzimuthUp},
+            {"lightAzimuthDown", &GUIButton::lightAzimuthDown},
+            {"lightInclineUp",   &GUIButton::lightInclineUp},
+            {"lightInclineDown", &GUIButton::lightInclineDown},
+            {"luminanceUp",      &GUIButton::luminanceUp},
+            {"luminanceDown",    &GUIButton::luminanceDown},
+            {"scaleUp",          &GUIButton::scaleUp},
+            {"scaleDown",        &GUIButton::scaleDown},
+            {"cameraSpeedUp",    &GUIButton::cameraSpeedUp},
+            {"cameraSpeedDown",  &GUIButton::cameraSpeedDown}
+        };
+
+        struct LayoutContext
+        {
+            GUIHandler* handler;
+            std::unordered_map<std::string, text::Font*> fonts;
+        };
+
+        std::wstring utf8ToWString(const std::string& utf8)
+        {
+            std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
+            return converter.from_bytes(utf8);
+        }
+
+        // Either a name from colorMap or [r, g, b, a]
+        glm::vec4 parseColor(const nlohmann::json& colorDesc)
+        {
+            if (colorDesc.is_string())
+            {
+                auto it = colorMap.find(colorDesc.get<std::string>());
+                if (it != colorMap.end())
+                {
+                    return it->second;
+                }
+
+                std::cerr << "Unknown color " << colorDesc << " in GUI layout, using DARK GRAY" << std::endl;
+                return colorMap.at("DARK GRAY");
+            }
+
+            return glm::vec4(colorDesc.at(0).get<float>(), colorDesc.at(1).get<float>(), colorDesc.at(2).get<float>(), colorDesc.at(3).get<float>());
+        }
+
+        // Builds the element described by desc and then its children, returns nullptr if the element could not be built
+        GUIElement* buildElement(const nlohmann::json& desc, LayoutContext& context)
+        {
+            GUIElementBuilder builder;
+            builder.setHandler(context.handler);
+
+            if (desc.contains("position"))
+            {
+                builder.setPosition(desc["position"].at(0).get<int>(), desc["position"].at(1).get<int>());
+            }
+            if (desc.contains("size"))
+            {
+                builder.setSize(desc["size"].at(0).get<int>(), desc["size"].at(1).get<int>());
+            }
+            if (desc.contains("flags")) // [isMovable, isResizable, isVisible, takesInput]
+            {
+                const nlohmann::json& flags = desc["flags"];
+                builder.setFlags(flags.at(0).get<bool>(), flags.at(1).get<bool>(), flags.at(2).get<bool>(), flags.at(3).get<bool>());
+            }
+            if (desc.contains("edge")) // [borderWidth, cornerRadius]
+            {
+                builder.setEdgeParameters(desc["edge"].at(0).get<int>(), desc["edge"].at(1).get<int>());
+            }
+            if (desc.contains("color"))
+            {
+                builder.setColor(parseColor(desc["color"]));
+            }
+
+            if (desc.contains("onClick"))
+            {
+                auto it = onClickFunctions.find(desc["onClick"].get<std::string>());
+                if (it != onClickFunctions.end())
+                {
+                    builder.setOnClick(it->second);
+                }
+                else
+                {
+                    std::cerr << "Unknown onClick " << desc["onClick"] << " in GUI layout, ignoring it" << std::endl;
+                }
+            }
+
+            if (desc.contains("text"))
+            {
+                builder.setText(utf8ToWString(desc["text"].get<std::string>()));
+            }
+            if (desc.contains("font"))
+            {
+                auto it = context.fonts.find(desc["font"].get<std::string>());
+                if (it != context.fonts.end())
+                {
+                    builder.setFont(it->second);
+                }
+                else
+                {
+                    std::cerr << "Font " << desc["font"] << " not declared in GUI layout, using the default font" << std::endl;
+                }
+            }
+            if (desc.contains("autoScaleText"))
+            {
+                builder.setAutoScaleText(desc["autoScaleText"].get<bool>());
+            }
+            if (desc.contains("textScale"))
+            {
+                builder.setTextScale(desc["textScale"].get<float>());
+            }
+            if (desc.contains("padding"))
+            {
+                builder.setPadding(desc["padding"].get<int>());
+            }
+
+            std::string type = desc.value("type", "element");
+            GUIElement* element = nullptr;
+            if (type == "element")
+            {
+                element = builder.buildElement();
+            }
+            else if (type == "button")
+            {
+                element = builder.buildButton();
+            }
+            else if (type == "text")
+            {
+                element = builder.buildText();
+            }
+            else if (type == "editText")
+            {
+                element = builder.buildEditText();
+            }
+            else
+            {
+                std::cerr << "Unknown element type " << type << " in GUI layout" << std::endl;
+            }
+
+            if (element == nullptr)
+            {
+                return nullptr;
+            }
+
+            if (desc.contains("children"))
+            {
+                try
+                {
+                    for (const nlohmann::json& childDesc : desc["children"])
+                    {
+                        GUIElement* child = buildElement(childDesc, context);
+                        if (child != nullptr)
+                        {
+                            element->addChild(child);
+                        }
+                    }
+                }
+                catch (nlohmann::json::exception&)
+                {
+                    delete element; // Along with the children added so far
+                    throw;
+                }
+            }
+
+            return element;
+        }
+    }
+
+#ifndef NDEBUG
+    namespace
+    {
+        // Whether element and its descendants ended up at the sum of their own and their ancestors' positions in desc,
+        // children that failed to build leave nothing to compare against so their siblings are not checked
+        bool isPlacedAsDescribed(const nlohmann::json& desc, GUIElement* element, int parentX, int parentY)
+        {
+            int x = parentX, y = parentY;
+            if (desc.contains("position"))
+            {
+                x += desc["position"].at(0).get<int>();
+                y += desc["position"].at(1).get<int>();
+            }
+            if (element->getXPos() != x || element->getYPos() != y)
+            {
+                std::cerr << "GUI layout element at " << element->getXPos() << ", " << element->getYPos() << " instead of " << x << ", " << y << std::endl;
+                return false;
+            }
+
+            std::vector<GUIElement*> children = element->getChildren();
+            if (!desc.contains("children") || desc["children"].size() != children.size())
+            {
+                return true;
+            }
+
+            for (size_t i = 0; i < children.size(); ++i)
+            {
+                if (!isPlacedAsDescribed(desc["children"][i], children[i], x, y))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+#endif
+
+    std::vector<GUIElement*> loadLayout(GUIHandler* handler, const std::filesystem::path& layoutPath)
+    {
+        std::vector<GUIElement*> roots;
+        if (handler == nullptr)
+        {
+            std::cerr << "Null handler passed to loadLayout" << std::endl;
+            return roots;
+        }
+
+        std::ifstream layoutFile(layoutPath);
+        if (!layoutFile.is_open())
+        {
+            std::cerr << "Failed to open GUI layout " << layoutPath << std::endl;
+            return roots;
+        }
+
+        LayoutContext context = { handler };
+        try
+        {
+            nlohmann::json layout;
+            layoutFile >> layout;
+
+            // Fonts are kept alive for the rest of the program, their Characters are referenced by the texts
+            // Each font parses its own metrics files, so they are loaded in parallel once the working
+            // directory and the default font path they share have been set up here
+            if (layout.contains("fonts"))
+            {
+                std::vector<std::pair<std::string, std::string>> fontDescs;
+                for (auto& [fontName, fontFolder] : layout["fonts"].items())
+                {
+                    fontDescs.emplace_back(fontName, fontFolder.get<std::string>());
+                }
+
+                bool prepared = true;
+                for (const auto& fontDesc : fontDescs)
+                {
+                    prepared = text::Font::prepareFontFolder(fontDesc.second) && prepared;
+                }
+
+                std::vector<text::Font*> fonts(fontDescs.size());
+                auto loadFonts = [&](size_t begin, size_t end)
+                {
+                    for (size_t i = begin; i < end; ++i)
+                    {
+                        fonts[i] = new text::Font(fontDescs[i].first, fontDescs[i].second);
+                    }
+                };
+                // A folder that could not be prepared is tried again by its constructor, which is only safe one at a time
+                if (prepared)
+                {
+                    jobs::getScheduler().parallelFor(0, fontDescs.size(), 1, loadFonts);
+                }
+                else
+                {
+                    loadFonts(0, fontDescs.size());
+                }
+
+                for (size_t i = 0; i < fontDescs.size(); ++i)
+                {
+                    context.fonts[fontDescs[i].first] = fonts[i];
+                }
+            }
+
+            for (const nlohmann::json& desc : layout.at("elements"))
+            {
+                GUIElement* root = buildElement(desc, context);
+                if (root != nullptr)
+                {
+                    // Children are built before being attached, so nested positions depend on addChild moving whole subtrees
+                    assert(isPlacedAsDescribed(desc, root, 0, 0));
+                    roots.emplace_back(root);
+                }
+            }
+        }
+        catch (nlohmann::json::exception& e)
+        {
+            std::cerr << "Error when parsing GUI layout " << layoutPath << ": " << e.what() << std::endl;
+
+            // Either the whole layout or nothing
+            for (GUIElement* root : roots)
+            {
+                delete root;
+            }
+            roots.clear();
+        }
+
+        return roots;
+    }
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <filesystem>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "gui.h"
+
+namespace gui
+{
+    // Builds every element described by a JSON layout file in one pass through GUIElementBuilder, all elements share
+    // the handler's programs and unit quad and each font is loaded once per file, see res/gui/controls.json for the format
+    // Returns the root elements in file order, or an empty vector if the file could not be read
+    std::vector<GUIElement*> loadLayout(GUIHandler* handler, const std::filesystem::path& layoutPath);
+}
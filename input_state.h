@@ -1,5 +1,7 @@
 #pragma once
 
+#include <atomic>
+
 class InputState
 {
 public:
@@ -26,6 +28,7 @@ public:
     KeyboardState getKeyboardState() const;
 
 private:
-    MouseState mouseState;
-    KeyboardState keyboardState;
+    // Set by the GUI on the render thread, read by the camera on the main thread
+    std::atomic<MouseState> mouseState;
+    std::atomic<KeyboardState> keyboardState;
 };
\ No newline at end of file
@@ -0,0 +1,317 @@
+#include <algorithm>
+
+#include "jobs.h"
+
+namespace jobs
+{
+    namespace
+    {
+        // Lets jobs spawned from a worker go to its own deque
+        thread_local const Scheduler* currentScheduler = nullptr;
+        thread_local unsigned int currentWorker = 0;
+    }
+
+    bool Counter::isDone() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return pending == 0;
+    }
+
+    Scheduler::Scheduler(unsigned int workerCount)
+    {
+        if (workerCount == 0)
+        {
+            unsigned int hardwareThreads = std::thread::hardware_concurrency();
+            workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+        }
+
+        startTime = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < workerCount; ++i)
+        {
+            workers.emplace_back(std::make_unique<Worker>());
+        }
+        // Started only once every worker exists, since they steal from each other
+        for (unsigned int i = 0; i < workerCount; ++i)
+        {
+            workers[i]->thread = std::thread(&Scheduler::workerLoop, this, i);
+        }
+    }
+
+    Scheduler::~Scheduler()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        sleepCondition.notify_all();
+
+        for (auto& worker : workers)
+        {
+            worker->thread.join();
+        }
+    }
+
+    void Scheduler::run(std::function<void()> task, Counter* counter)
+    {
+        if (counter != nullptr)
+        {
+            std::lock_guard<std::mutex> lock(counter->mutex);
+            ++counter->pending;
+        }
+        push({ std::move(task), counter });
+    }
+
+    void Scheduler::runAfter(Counter& dependency, std::function<void()> task, Counter* counter)
+    {
+        // Counted right away, so waiting on counter also waits for the dependency
+        if (counter != nullptr)
+        {
+            std::lock_guard<std::mutex> lock(counter->mutex);
+            ++counter->pending;
+        }
+
+        auto continuation = [this, task = std::move(task), counter]() mutable
+        {
+            push({ std::move(task), counter });
+        };
+
+        {
+            std::lock_guard<std::mutex> lock(dependency.mutex);
+            if (dependency.pending > 0)
+            {
+                dependency.continuations.emplace_back(std::move(continuation));
+                return;
+            }
+        }
+        continuation();
+    }
+
+    void Scheduler::wait(Counter& counter)
+    {
+        unsigned int workerIndex = currentScheduler == this ? currentWorker : (unsigned int)workers.size();
+        while (!counter.isDone())
+        {
+            Job job;
+            if (tryGetJob(workerIndex, job))
+            {
+                execute(workerIndex, job);
+            }
+            else
+            {
+                std::this_thread::yield(); // The remaining jobs are running on other threads
+            }
+        }
+    }
+
+    void Scheduler::parallelFor(size_t begin, size_t end, size_t grainSize, const std::function<void(size_t, size_t)>& body)
+    {
+        if (begin >= end)
+        {
+            return;
+        }
+        grainSize = std::max<size_t>(grainSize, 1);
+
+        // A single chunk is not worth a trip through the deques
+        if (end - begin <= grainSize)
+        {
+            body(begin, end);
+            return;
+        }
+
+        Counter counter;
+        for (size_t chunkBegin = begin; chunkBegin < end; chunkBegin += grainSize)
+        {
+            size_t chunkEnd = std::min(chunkBegin + grainSize, end);
+            run([&body, chunkBegin, chunkEnd]() { body(chunkBegin, chunkEnd); }, &counter);
+        }
+        wait(counter);
+    }
+
+    void Scheduler::postContinuation(std::function<void()> task)
+    {
+        std::function<void()> wake;
+        {
+            std::lock_guard<std::mutex> lock(continuationsMutex);
+            continuations.emplace_back(std::move(task));
+            wake = continuationWake;
+        }
+        if (wake)
+        {
+            wake();
+        }
+    }
+
+    void Scheduler::setContinuationWake(std::function<void()> wake)
+    {
+        std::lock_guard<std::mutex> lock(continuationsMutex);
+        continuationWake = std::move(wake);
+    }
+
+    size_t Scheduler::runContinuations()
+    {
+        std::vector<std::function<void()>> tasks;
+        {
+            std::lock_guard<std::mutex> lock(continuationsMutex);
+            tasks.swap(continuations);
+        }
+        for (const auto& task : tasks)
+        {
+            task();
+        }
+        return tasks.size();
+    }
+
+    unsigned int Scheduler::getWorkerCount() const
+    {
+        return (unsigned int)workers.size();
+    }
+
+    std::vector<WorkerStats> Scheduler::getStats() const
+    {
+        float elapsedMicroseconds = (float)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+
+        std::vector<WorkerStats> stats;
+        for (const auto& worker : workers)
+        {
+            float busy = (float)worker->busyMicroseconds.load(std::memory_order_relaxed);
+            stats.push_back({ worker->jobsRun.load(std::memory_order_relaxed), worker->steals.load(std::memory_order_relaxed),
+                              elapsedMicroseconds > 0.0f ? busy / elapsedMicroseconds : 0.0f });
+        }
+        return stats;
+    }
+
+    void Scheduler::workerLoop(unsigned int workerIndex)
+    {
+        currentScheduler = this;
+        currentWorker = workerIndex;
+
+        while (true)
+        {
+            Job job;
+            if (tryGetJob(workerIndex, job))
+            {
+                execute(workerIndex, job);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleepCondition.wait(lock, [this]() { return stopping || queuedJobs.load(std::memory_order_acquire) > 0; });
+            if (stopping)
+            {
+                return;
+            }
+        }
+    }
+
+    void Scheduler::push(Job job)
+    {
+        unsigned int workerIndex = currentScheduler == this
+            ? currentWorker
+            : nextWorker.fetch_add(1, std::memory_order_relaxed) % (unsigned int)workers.size();
+
+        {
+            std::lock_guard<std::mutex> lock(workers[workerIndex]->dequeMutex);
+            workers[workerIndex]->jobs.emplace_back(std::move(job));
+        }
+
+        {
+            // Under sleepMutex so a worker can not miss the wakeup between its check and going to sleep
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            queuedJobs.fetch_add(1, std::memory_order_release);
+        }
+        sleepCondition.notify_one();
+    }
+
+    bool Scheduler::tryGetJob(unsigned int workerIndex, Job& job)
+    {
+        if (queuedJobs.load(std::memory_order_acquire) == 0)
+        {
+            return false;
+        }
+
+        // Own deque first, newest job first since its data is most likely still in cache
+        if (workerIndex < workers.size())
+        {
+            Worker& worker = *workers[workerIndex];
+            std::lock_guard<std::mutex> lock(worker.dequeMutex);
+            if (!worker.jobs.empty())
+            {
+                job = std::move(worker.jobs.back());
+                worker.jobs.pop_back();
+                queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+
+        // Then the oldest job of another worker, starting after this one so thieves spread out
+        unsigned int workerCount = (unsigned int)workers.size();
+        for (unsigned int offset = 1; offset <= workerCount; ++offset)
+        {
+            unsigned int victimIndex = (workerIndex + offset) % workerCount;
+            if (victimIndex == workerIndex)
+            {
+                continue;
+            }
+
+            Worker& victim = *workers[victimIndex];
+            std::lock_guard<std::mutex> lock(victim.dequeMutex);
+            if (!victim.jobs.empty())
+            {
+                job = std::move(victim.jobs.front());
+                victim.jobs.pop_front();
+                queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+                if (workerIndex < workers.size())
+                {
+                    workers[workerIndex]->steals.fetch_add(1, std::memory_order_relaxed);
+                }
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void Scheduler::execute(unsigned int workerIndex, Job& job)
+    {
+        auto start = std::chrono::steady_clock::now();
+        job.task();
+
+        // Work done by threads outside the pool (e.g. in wait) is not counted
+        if (workerIndex < workers.size())
+        {
+            Worker& worker = *workers[workerIndex];
+            worker.jobsRun.fetch_add(1, std::memory_order_relaxed);
+            worker.busyMicroseconds.fetch_add(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+        }
+
+        finish(job.counter);
+    }
+
+    void Scheduler::finish(Counter* counter)
+    {
+        if (counter == nullptr)
+        {
+            return;
+        }
+
+        // counter must not be touched after the lock is released, a waiter may destroy it as soon as it is done
+        std::vector<std::function<void()>> ready;
+        {
+            std::lock_guard<std::mutex> lock(counter->mutex);
+            if (--counter->pending == 0)
+            {
+                ready.swap(counter->continuations);
+            }
+        }
+        for (auto& continuation : ready)
+        {
+            continuation();
+        }
+    }
+
+    Scheduler& getScheduler()
+    {
+        static Scheduler scheduler;
+        return scheduler;
+    }
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing job scheduler shared by everything that runs work in parallel, use getScheduler rather than
+// creating threads. Every worker owns a deque, it pushes and pops its own jobs at the back while idle workers
+// steal from the front of the others', so jobs spawned by a job stay on the same worker while the rest balances out
+namespace jobs
+{
+    class Scheduler;
+
+    // Number of jobs still to finish, a job run with a counter increments it when scheduled and decrements it when done.
+    // Jobs can be made to depend on a counter with Scheduler::runAfter
+    class Counter
+    {
+    public:
+        bool isDone() const;
+
+    private:
+        friend class Scheduler;
+
+        // A plain count under a mutex rather than an atomic, so the last job has released the counter
+        // by the time a waiter can see it done (and e.g. destroy it)
+        mutable std::mutex mutex;
+        int pending = 0;
+        std::vector<std::function<void()>> continuations; // Scheduled once pending reaches 0
+    };
+
+    struct WorkerStats
+    {
+        unsigned long long jobsRun;
+        unsigned long long steals; // Jobs taken from another worker's deque
+        float utilization;         // Fraction of the time since the scheduler started spent running jobs
+    };
+
+    class Scheduler
+    {
+    public:
+        // workerCount of 0 uses one worker per hardware thread, minus one for the thread submitting work
+        explicit Scheduler(unsigned int workerCount = 0);
+        ~Scheduler();
+
+        Scheduler(const Scheduler&) = delete;
+        Scheduler& operator=(const Scheduler&) = delete;
+
+        // Schedules task on a worker, counter (if any) covers it until it has run
+        void run(std::function<void()> task, Counter* counter = nullptr);
+        // Schedules task once dependency is done, right away if it already is
+        void runAfter(Counter& dependency, std::function<void()> task, Counter* counter = nullptr);
+        // Runs jobs on the calling thread until counter is done, instead of blocking it
+        void wait(Counter& counter);
+
+        // Calls body(rangeBegin, rangeEnd) for chunks of at most grainSize covering [begin, end) in
+        // parallel, the calling thread takes part and it returns once every chunk is done
+        void parallelFor(size_t begin, size_t end, size_t grainSize, const std::function<void(size_t, size_t)>& body);
+
+        // Continuations run on the thread that calls runContinuations, for work that has to happen on a particular
+        // thread once jobs are done, e.g. uploading decoded data. The render thread runs them once per frame
+        void postContinuation(std::function<void()> task);
+        // Called by postContinuation after queueing, so a thread sleeping until it has work can be woken up
+        void setContinuationWake(std::function<void()> wake);
+        // Returns the number of continuations run
+        size_t runContinuations();
+
+        unsigned int getWorkerCount() const;
+        std::vector<WorkerStats> getStats() const;
+
+    private:
+        struct Job
+        {
+            std::function<void()> task;
+            Counter* counter = nullptr;
+        };
+
+        struct Worker
+        {
+            std::thread thread;
+            std::mutex dequeMutex;
+            std::deque<Job> jobs;
+
+            std::atomic<unsigned long long> jobsRun{ 0 };
+            std::atomic<unsigned long long> steals{ 0 };
+            std::atomic<long long> busyMicroseconds{ 0 };
+        };
+
+        void workerLoop(unsigned int workerIndex);
+        void push(Job job);
+        // Pops from the deque of workerIndex, or steals if it is empty, workerIndex is the worker count for non-workers
+        bool tryGetJob(unsigned int workerIndex, Job& job);
+        void execute(unsigned int workerIndex, Job& job);
+        void finish(Counter* counter);
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::atomic<bool> stopping{ false };
+        std::atomic<unsigned int> nextWorker{ 0 }; // Round robin target for jobs submitted from outside the workers
+
+        std::atomic<int> queuedJobs{ 0 };
+        std::mutex sleepMutex;
+        std::condition_variable sleepCondition;
+
+        std::mutex continuationsMutex;
+        std::vector<std::function<void()>> continuations;
+        std::function<void()> continuationWake;
+
+        std::chrono::steady_clock::time_point startTime;
+    };
+
+    // The scheduler shared by the whole program, created on first use
+    Scheduler& getScheduler();
+}
@@ -1,10 +1,101 @@
 #include <iostream>
+#include <string>
+#include <cstdlib>
+#include <cstdio>
 
 #include "renderer.h"
 
 int main(int argc, char* args[])
 {
-    renderer::Renderer* renderer = new renderer::Renderer();
+    // --record <file> and --replay <file> record or replay a session, --hidden creates the window hidden,
+    // --sim-hz <n> sets the fixed update rate, --max-fps <n> caps the frame rate, --no-vsync disables vsync
+    // and --on-demand only draws frames when something changed.
+    // For scripted runs --model <file> and --skybox <name> pick the assets, --resolution <w>x<h> and --msaa <n>
+    // set up the window, --frames <n> quits after n frames and --report <file> writes the run summary as JSON.
+    // --record-camera <file> records camera keyframes, --camera-path <file> flies along them and quits at the end,
+    // with --path-fps <n> the path advances by 1/n seconds per frame so every run renders the same poses
+    renderer::RendererOptions options;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = args[i];
+        if (arg == "--record" && i + 1 < argc)
+        {
+            options.recordPath = args[++i];
+        }
+        else if (arg == "--replay" && i + 1 < argc)
+        {
+            options.replayPath = args[++i];
+        }
+        else if (arg == "--hidden")
+        {
+            options.hidden = true;
+        }
+        else if (arg == "--sim-hz" && i + 1 < argc)
+        {
+            options.simulationHz = std::atoi(args[++i]);
+        }
+        else if (arg == "--max-fps" && i + 1 < argc)
+        {
+            options.maxFps = std::atoi(args[++i]);
+        }
+        else if (arg == "--no-vsync")
+        {
+            options.vsync = false;
+        }
+        else if (arg == "--on-demand")
+        {
+            options.onDemand = true;
+        }
+        else if (arg == "--model" && i + 1 < argc)
+        {
+            options.modelFile = args[++i];
+        }
+        else if (arg == "--skybox" && i + 1 < argc)
+        {
+            options.cubemapFile = args[++i];
+        }
+        else if (arg == "--resolution" && i + 1 < argc)
+        {
+            if (std::sscanf(args[++i], "%dx%d", &options.windowWidth, &options.windowHeight) != 2 || options.windowWidth <= 0 || options.windowHeight <= 0)
+            {
+                std::cerr << "Invalid resolution " << args[i] << ", expected <width>x<height>" << std::endl;
+                return -1;
+            }
+        }
+        else if (arg == "--msaa" && i + 1 < argc)
+        {
+            options.msaaSamples = std::atoi(args[++i]);
+        }
+        else if (arg == "--frames" && i + 1 < argc)
+        {
+            options.frameCount = std::atoi(args[++i]);
+        }
+        else if (arg == "--report" && i + 1 < argc)
+        {
+            options.reportPath = args[++i];
+        }
+        else if (arg == "--record-camera" && i + 1 < argc)
+        {
+            options.cameraRecordPath = args[++i];
+        }
+        else if (arg == "--camera-path" && i + 1 < argc)
+        {
+            options.cameraPathFile = args[++i];
+        }
+        else if (arg == "--path-fps" && i + 1 < argc)
+        {
+            options.pathFps = std::atoi(args[++i]);
+        }
+        else
+        {
+            std::cerr << "Unknown argument " << arg << ", usage: " << args[0] << " [--record <file> | --replay <file>] [--hidden] [--sim-hz <n>] [--max-fps <n>] [--no-vsync] [--on-demand]"
+                " [--model <file>] [--skybox <name>] [--resolution <w>x<h>] [--msaa <n>] [--frames <n>] [--report <file>]"
+                " [--record-camera <file>] [--camera-path <file> [--path-fps <n>]]" << std::endl;
+            return -1;
+        }
+    }
+
+    renderer::Renderer* renderer = new renderer::Renderer(options);
     if (renderer->RENDERER_STATE == renderer::RENDERER_CREATE_ERROR)
     {
         return -1;
@@ -1,23 +1,85 @@
+#include <algorithm>
+
 #include "pub_sub.h"
 
 Publisher::~Publisher() {}
 
+void Publisher::subscribe(Subscriber* subscriber, event::EventType type)
+{
+    std::vector<Subscriber*>& subscribers = subscribersByType[(size_t)type];
+    if (std::find(subscribers.begin(), subscribers.end(), subscriber) == subscribers.end())
+    {
+        subscribers.push_back(subscriber);
+    }
+}
+
 void Publisher::subscribe(Subscriber* subscriber)
 {
-    subscribers.push_back(subscriber);
+    for (size_t type = 0; type < subscribersByType.size(); ++type)
+    {
+        subscribe(subscriber, (event::EventType)type);
+    }
+}
+
+void Publisher::unsubscribe(Subscriber* subscriber, event::EventType type)
+{
+    std::vector<Subscriber*>& subscribers = subscribersByType[(size_t)type];
+    auto it = std::find(subscribers.begin(), subscribers.end(), subscriber);
+    if (it == subscribers.end())
+    {
+        return;
+    }
+
+    if (publishDepth > 0)
+    {
+        // Erasing would shift the array under the loop in publish
+        *it = nullptr;
+        needsCompaction = true;
+    }
+    else
+    {
+        subscribers.erase(it);
+    }
 }
 
 void Publisher::unsubscribe(Subscriber* subscriber)
 {
-    subscribers.remove(subscriber);
+    for (size_t type = 0; type < subscribersByType.size(); ++type)
+    {
+        unsubscribe(subscriber, (event::EventType)type);
+    }
+}
+
+void Publisher::publish(const event::Event& event)
+{
+    std::vector<Subscriber*>& subscribers = subscribersByType[(size_t)event.getType()];
+
+    ++publishDepth;
+    // Indexed with the count at the start, subscribers added from notify may reallocate the array
+    // and only get events from the next publish
+    size_t count = subscribers.size();
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (Subscriber* subscriber = subscribers[i])
+        {
+            subscriber->notify(&event);
+        }
+    }
+    --publishDepth;
+
+    if (publishDepth == 0 && needsCompaction)
+    {
+        compactSubscribers();
+    }
 }
 
-void Publisher::publish(const event::Event* event)
+void Publisher::compactSubscribers()
 {
-    for (auto subscriber : subscribers)
+    for (std::vector<Subscriber*>& subscribers : subscribersByType)
     {
-        subscriber->notify(event);
+        subscribers.erase(std::remove(subscribers.begin(), subscribers.end(), nullptr), subscribers.end());
     }
+    needsCompaction = false;
 }
 
 Subscriber::~Subscriber() {}
@@ -1,23 +1,37 @@
 #pragma once
 
-#include <list>
+#include <array>
+#include <vector>
 #include "event.h"
 
 // Forward declaration
 class Subscriber;
 
 // TODO: Lifetime of subscribers?
+// Subscribers register per event type and are kept in one contiguous array per type,
+// so publishing only visits the subscribers interested in the event
 class Publisher
 {
 public:
     virtual ~Publisher();
 
+    void subscribe(Subscriber* subscriber, event::EventType type);
+    // Subscribes to every event type
     void subscribe(Subscriber* subscriber);
+    // Safe to call from within notify, the subscriber gets no further events from the current publish
+    void unsubscribe(Subscriber* subscriber, event::EventType type);
     void unsubscribe(Subscriber* subscriber);
-    void publish(const event::Event* event);
+    // Subscribers get a pointer to event only for the duration of their notify, so
+    // events can live on the publisher's stack instead of being allocated per publish
+    void publish(const event::Event& event);
 
 private:
-    std::list<Subscriber*> subscribers;
+    // Removes the entries nulled by unsubscribing during a publish
+    void compactSubscribers();
+
+    std::array<std::vector<Subscriber*>, (size_t)event::EventType::Count> subscribersByType;
+    int publishDepth = 0; // Greater than 0 while inside publish, publish can be reentered from notify
+    bool needsCompaction = false;
 };
 
 class Subscriber
@@ -26,4 +40,4 @@ public:
     virtual ~Subscriber();
 
     virtual void notify(const event::Event* event) = 0;
-};
\ No newline at end of file
+};
@@ -5,11 +5,15 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
 #include <algorithm>
+#include <chrono>
+#include <climits>
 
 #include "renderer.h"
 #include "text.h"
 #include "shaders.h"
 #include "texture_loader.h"
+#include "gui_layout.h"
+#include "jobs.h"
 #define TINYGLTF_IMPLEMENTATION
 #include "tiny_gltf.h"
 #define STB_IMAGE_IMPLEMENTATION
@@ -19,17 +23,33 @@
 
 namespace renderer
 {
-    Renderer::Renderer()
+    Renderer::Renderer(const RendererOptions& options) : options(options)
     {
         window = nullptr;
         context = nullptr;
-        if (SDL_GLAD_init(&window, &context)
-            && initializeModel()
-            && initializeShaders()
-            && initializeCubemaps()
-            && initializeGUI())
+        reportEnabled = options.frameCount > 0 || !options.reportPath.empty();
+        if (!options.modelFile.empty())
+        {
+            targetGLTFfile = options.modelFile;
+        }
+        if (!options.cubemapFile.empty())
+        {
+            targetCubemapFile = options.cubemapFile;
+        }
+
+        registerEventHandlers();
+        if (initializeSession()
+            && SDL_GLAD_init(&window, &context)
+            && timeLoad("model", &Renderer::initializeModel)
+            && timeLoad("shaders", &Renderer::initializeShaders)
+            && timeLoad("cubemap", &Renderer::initializeCubemaps)
+            && timeLoad("gui", &Renderer::initializeGUI))
         {
             RENDERER_STATE = RENDERER_CREATED;
+            if (reportEnabled)
+            {
+                report.sampleMemory("after_load");
+            }
         } 
         else 
         {
@@ -42,12 +62,18 @@ namespace renderer
 
     Renderer::~Renderer() 
     {   
+        delete recorder;
+        delete replayer;
+
         // This will also delete any GUIElement objects using the guiHandler
         delete guiHandler;
 
         // Delete defaultFont created using new in getDefaultFont (or delete nullptr if it wasn't created)
         delete text::Font::defaultFont;
 
+        // Delete the font texture arrays shared by all GUIText elements
+        gui::GUIFontAtlas::destroy();
+
         // Clean up shaderProgram, modelTextureIDs, VAOs, VBOs
         glDeleteProgram(shaderProgram);
         for (const auto& texture : modelTextureIDs)
@@ -68,6 +94,10 @@ namespace renderer
         glDeleteVertexArrays(1, &skyboxVAO);
         glDeleteBuffers(1, &skyboxVBO);
 
+        glDeleteBuffers(1, &frameConstantsUBO);
+        drawDataBuffer.destroy(); // Before the context goes away
+        glDeleteBuffers(1, &drawIdVBO);
+
         // SDL clean up
         SDL_GL_DeleteContext(context);
         SDL_DestroyWindow(window);
@@ -76,43 +106,160 @@ namespace renderer
 
     void Renderer::notify(const event::Event* event) 
     {
-        if (const event::QuitEvent* quitEvent = dynamic_cast<const event::QuitEvent*>(event)) 
+        if (recorder != nullptr)
         {
-            quit();
+            recorder->recordEvent(simulationStep, *event);
         }
-        else if (const event::NextModelEvent* nextModelEvent = dynamic_cast<const event::NextModelEvent*>(event))
+        // The recorded events are queued by replayStep instead, the GUI publishes its own while replaying too
+        if (replayer != nullptr)
         {
-            nextTargetGLTFmodel();
+            return;
         }
-        else if (const event::NextCubemapEvent* nextCubemapEvent = dynamic_cast<const event::NextCubemapEvent*>(event))
+
+        deliverEvent(event);
+    }
+
+    void Renderer::deliverEvent(const event::Event* event)
+    {
+        if (deferEvents)
         {
-            nextTargetCubemap();
+            deferredEvents.add(*event);
         }
-        else if (const event::LightAzimuthChangeEvent *lightAzimuthChangeEvent = dynamic_cast<const event::LightAzimuthChangeEvent*>(event))
+        else
         {
-            lightAzimuth += lightAzimuthChangeEvent->delta;
+            eventDispatcher.dispatch(event);
         }
-        else if (const event::LightInclineChangeEvent *lightInclineChangeEvent = dynamic_cast<const event::LightInclineChangeEvent*>(event))
+    }
+
+    // Events whose handlers reload assets, at most one of them is handled per frame
+    static bool isHeavyEvent(event::EventType type)
+    {
+        return type == event::EventType::NextModel || type == event::EventType::NextCubemap;
+    }
+
+    void Renderer::processDeferredEvents()
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto overBudget = [&]()
         {
-            lightIncline += lightInclineChangeEvent->delta;
-        }
-        else if (const event::LuminanceChangeEvent* luminanceChangeEvent = dynamic_cast<const event::LuminanceChangeEvent*>(event))
+            return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() > DEFERRED_EVENTS_BUDGET_MS;
+        };
+
+        // Cheap events first so a heavy one can not starve them, whatever is left over waits for the next frame
+        event::EventRecord record;
+        for (size_t type = 0; type < (size_t)event::EventType::Count && !overBudget(); ++type)
         {
-            luminanceFactor += luminanceChangeEvent->delta;
+            if (!isHeavyEvent((event::EventType)type) && deferredEvents.take((event::EventType)type, record))
+            {
+                eventDispatcher.dispatch(&record.get());
+            }
         }
-        else if (const event::ScaleChangeEvent *scaleChangeEvent = dynamic_cast<const event::ScaleChangeEvent*>(event))
+        for (size_t type = 0; type < (size_t)event::EventType::Count && !overBudget(); ++type)
         {
-            scaleFactor += scaleChangeEvent->delta;
+            if (isHeavyEvent((event::EventType)type) && deferredEvents.take((event::EventType)type, record))
+            {
+                eventDispatcher.dispatch(&record.get());
+                break;
+            }
         }
-        else if (const event::CameraSpeedChangeEvent *cameraSpeedChangeEvent = dynamic_cast<const event::CameraSpeedChangeEvent*>(event))
+    }
+
+    void Renderer::registerEventHandlers()
+    {
+        eventDispatcher.on<event::QuitEvent>([this](const event::QuitEvent&)
         {
-            camera.cameraSpeed *= cameraSpeedChangeEvent->factor;
-        }
+            quit();
+        });
+        eventDispatcher.on<event::NextModelEvent>([this](const event::NextModelEvent&)
+        {
+            nextTargetGLTFmodel();
+        });
+        eventDispatcher.on<event::NextCubemapEvent>([this](const event::NextCubemapEvent&)
+        {
+            nextTargetCubemap();
+        });
+        eventDispatcher.on<event::LightAzimuthChangeEvent>([this](const event::LightAzimuthChangeEvent& e)
+        {
+            lightAzimuth += e.delta;
+        });
+        eventDispatcher.on<event::LightInclineChangeEvent>([this](const event::LightInclineChangeEvent& e)
+        {
+            lightIncline += e.delta;
+        });
+        eventDispatcher.on<event::LuminanceChangeEvent>([this](const event::LuminanceChangeEvent& e)
+        {
+            luminanceFactor += e.delta;
+        });
+        eventDispatcher.on<event::ScaleChangeEvent>([this](const event::ScaleChangeEvent& e)
+        {
+            scaleFactor += e.delta;
+        });
+        eventDispatcher.on<event::CameraSpeedChangeEvent>([this](const event::CameraSpeedChangeEvent& e)
+        {
+            float factor = e.factor;
+            postToSimulation([this, factor]() { camera.cameraSpeed *= factor; });
+        });
     }
 
     void Renderer::quit()
     {
         running = false;
+        if (options.onDemand)
+        {
+            wakeSimulation();
+        }
+    }
+
+    bool Renderer::timeLoad(const std::string& stage, bool (Renderer::*initialize)())
+    {
+        double start = getSeconds();
+        bool initialized = (this->*initialize)();
+        if (reportEnabled)
+        {
+            glFinish(); // Include the uploads the driver has not done yet
+            report.addLoadTime(stage, (getSeconds() - start) * 1000.0);
+        }
+        return initialized;
+    }
+
+    bool Renderer::initializeSession()
+    {
+        if (!options.recordPath.empty() && !options.replayPath.empty())
+        {
+            std::cerr << "Can not record and replay a session at the same time" << std::endl;
+            return false;
+        }
+
+        if (!options.recordPath.empty())
+        {
+            recorder = new session::SessionRecorder();
+            if (!recorder->open(options.recordPath))
+            {
+                return false;
+            }
+            std::cout << "Recording session to " << options.recordPath << std::endl;
+        }
+
+        if (!options.replayPath.empty())
+        {
+            replayer = new session::SessionReplayer();
+            if (!replayer->open(options.replayPath))
+            {
+                return false;
+            }
+            std::cout << "Replaying " << replayer->getRecordCount() << " session records from " << options.replayPath << std::endl;
+        }
+
+        if (!options.cameraPathFile.empty())
+        {
+            if (!cameraPath.load(options.cameraPathFile))
+            {
+                return false;
+            }
+            std::cout << "Playing " << cameraPath.getKeyframeCount() << " camera keyframes over " << cameraPath.getDuration() << " s from " << options.cameraPathFile << std::endl;
+        }
+
+        return true;
     }
 
     bool Renderer::SDL_GLAD_init(SDL_Window** window, SDL_GLContext* context) 
@@ -132,14 +279,19 @@ namespace renderer
 
         WINDOW_WIDTH = (float)(DM.w / 1.5f);
         WINDOW_HEIGHT = (float)(DM.h / 1.5f);
+        if (options.windowWidth > 0 && options.windowHeight > 0)
+        {
+            WINDOW_WIDTH = (float)options.windowWidth;
+            WINDOW_HEIGHT = (float)options.windowHeight;
+        }
 
         SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
         SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 4);
-        SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, 1);
-        SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES, 4); // 4x MSAA
+        SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, options.msaaSamples > 0 ? 1 : 0);
+        SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES, std::max(options.msaaSamples, 0));
 
         *window = SDL_CreateWindow("Playground", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 
-            (int)WINDOW_WIDTH, (int)WINDOW_HEIGHT, SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
+            (int)WINDOW_WIDTH, (int)WINDOW_HEIGHT, SDL_WINDOW_OPENGL | (options.hidden ? SDL_WINDOW_HIDDEN : SDL_WINDOW_SHOWN) | SDL_WINDOW_RESIZABLE);
         if (*window == nullptr)
         {
             std::cerr << "Failed to create window: " << SDL_GetError() << std::endl;
@@ -161,7 +313,10 @@ namespace renderer
 
         glEnable(GL_DEPTH_TEST);
         glEnable(GL_CULL_FACE);
-        glEnable(GL_MULTISAMPLE);
+        if (options.msaaSamples > 0)
+        {
+            glEnable(GL_MULTISAMPLE);
+        }
         glCullFace(GL_BACK);
         glFrontFace(GL_CCW);
 
@@ -203,6 +358,13 @@ namespace renderer
                 }
             }
 
+            // Also accept a path, so models outside MODELS_PATH can be benchmarked
+            std::error_code error;
+            if (targetGLTFpath.empty() && std::filesystem::is_regular_file(targetGLTFfile, error))
+            {
+                targetGLTFpath = targetGLTFfile;
+            }
+
             if (targetGLTFpath.empty())
             {
                 std::cerr << "Target gltf file not found, object initialization failed" << std::endl;
@@ -220,6 +382,8 @@ namespace renderer
         modelTextureIDs = utilgltf::createTextureObjects(targetGLTFmodel);
         VBOs = utilgltf::createVBOs(targetGLTFmodel);
         VAOs = utilgltf::createVAOs(targetGLTFmodel, VBOs, meshToVertexArrays);
+        attachDrawIds();
+        meshBounds = utilgltf::computeMeshBounds(targetGLTFmodel);
 
         // TODO: Add error checks
 
@@ -251,10 +415,6 @@ namespace renderer
 
         glUseProgram(shaderProgram);
 
-        modelViewProjMatrixLoc = glGetUniformLocation(shaderProgram, "uModelViewProjMatrix");
-        modelViewMatrixLoc = glGetUniformLocation(shaderProgram, "uModelViewMatrix");
-        normalMatrixLoc = glGetUniformLocation(shaderProgram, "uNormalMatrix");
-
         lightDirectionLoc = glGetUniformLocation(shaderProgram, "uLightDirection");
         lightIntensityLoc = glGetUniformLocation(shaderProgram, "uLightIntensity");
 
@@ -272,6 +432,11 @@ namespace renderer
         occlusionStrengthLoc = glGetUniformLocation(shaderProgram, "uOcclusionStrength");
         applyOcclusionLoc = glGetUniformLocation(shaderProgram, "uApplyOcclusion");
 
+        // View, projection and time are shared by every pass through the FrameConstants block
+        frameConstantsUBO = shaders::createFrameConstantsBuffer();
+        // Grown later by submitDrawCommands if a frame has more draws
+        reserveDrawData(INITIAL_DRAW_DATA_CAPACITY);
+
         std::cout << "Successfully initialized shaders" << std::endl;
         return true;
     }
@@ -312,9 +477,6 @@ namespace renderer
             }
         }
 
-        viewSkyboxLoc = glGetUniformLocation(shaderProgramSkybox, "view");
-        projectionSkyboxLoc = glGetUniformLocation(shaderProgramSkybox, "projection");
-
         // Create targetCubemap from targetCubemapPath
         targetCubemap = CubeMap();
         targetCubemap.path = targetCubemapPath;
@@ -406,99 +568,25 @@ namespace renderer
     {
         guiHandler = new gui::GUIHandler(WINDOW_WIDTH, WINDOW_HEIGHT);
 
-        // Pub-sub
-        guiHandler->subscribe(this);
-        this->subscribe(guiHandler);
-
-        auto font1 = new text::Font("NotoSans", "res/fonts/NotoSans");
-        auto font2 = new text::Font("Coiny", "res/fonts/Coiny");
-        auto font3 = new text::Font("JetBrainsMono", "res/fonts/JetBrainsMono");
-
-        auto lightInclBase = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(30, 30).setSize(200, 50).setFlags(false, false, true, true).buildElement();
-        auto lightInclText = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(45, 0).setSize(110, 50).setFlags(false, false, true, false).setColor(gui::colorMap.at("WHITE")).setText(L"LIGHT\nHEIGHT").setFont(font3).buildText();
-        auto lightInclDownButton = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(5, 5).setSize(40, 40).setFlags(false, false, true, true).setColor(gui::colorMap.at("GRAY")).setOnClick(&gui::GUIButton::lightInclineDown).buildButton();
-        auto lightInclUpButton = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(155, 5).setSize(40, 40).setFlags(false, false, true, true).setColor(gui::colorMap.at("GRAY")).setOnClick(&gui::GUIButton::lightInclineUp).buildButton();
-        auto lightInclDownButtonText = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(2, 5).setSize(40, 80).setFlags(false, false, true, false).setColor(gui::colorMap.at("WHITE")).setText(L"-").setFont(font1).setAutoScaleText(false).setTextScale(1.5f).buildText();
-        auto lightInclUpButtonText = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(1, 1).setSize(40, 60).setFlags(false, false, true, false).setColor(gui::colorMap.at("WHITE")).setText(L"+").setFont(font1).setAutoScaleText(false).buildText();
-
-        lightInclBase->addChild(lightInclText);
-        lightInclBase->addChild(lightInclUpButton);
-        lightInclBase->addChild(lightInclDownButton);
-        lightInclUpButton->addChild(lightInclUpButtonText);
-        lightInclDownButton->addChild(lightInclDownButtonText);
-
-        auto lightAzimBase = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(30, 90).setSize(200, 50).setFlags(false, false, true, true).buildElement();
-        auto lightAzimText = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(45, 0).setSize(110, 50).setFlags(false, false, true, false).setColor(gui::colorMap.at("WHITE")).setText(L"LIGHT\nROTATION").setFont(font3).buildText();
-        auto lightAzimDownButton = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(5, 5).setSize(40, 40).setFlags(false, false, true, true).setColor(gui::colorMap.at("GRAY")).setOnClick(&gui::GUIButton::lightAzimuthDown).buildButton();
-        auto lightAzimUpButton = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(155, 5).setSize(40, 40).setFlags(false, false, true, true).setColor(gui::colorMap.at("GRAY")).setOnClick(&gui::GUIButton::lightAzimuthUp).buildButton();
-        auto lightAzimDownButtonText = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(2, 5).setSize(40, 80).setFlags(false, false, true, false).setColor(gui::colorMap.at("WHITE")).setText(L"-").setFont(font1).setAutoScaleText(false).setTextScale(1.5f).buildText();
-        auto lightAzimUpButtonText = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(1, 1).setSize(40, 60).setFlags(false, false, true, false).setColor(gui::colorMap.at("WHITE")).setText(L"+").setFont(font1).setAutoScaleText(false).buildText();
-
-        lightAzimBase->addChild(lightAzimText);
-        lightAzimBase->addChild(lightAzimUpButton);
-        lightAzimBase->addChild(lightAzimDownButton);
-        lightAzimUpButton->addChild(lightAzimUpButtonText);
-        lightAzimDownButton->addChild(lightAzimDownButtonText);
-
-        auto luminanceBase = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(30, 150).setSize(200, 50).setFlags(false, false, true, true).buildElement();
-        auto luminanceText = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(45, -10).setSize(110, 50).setFlags(false, false, true, false).setColor(gui::colorMap.at("WHITE")).setText(L"BRIGHTNESS").setFont(font3).buildText();
-        auto luminanceDownButton = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(5, 5).setSize(40, 40).setFlags(false, false, true, true).setColor(gui::colorMap.at("GRAY")).setOnClick(&gui::GUIButton::luminanceDown).buildButton();
-        auto luminanceUpButton = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(155, 5).setSize(40, 40).setFlags(false, false, true, true).setColor(gui::colorMap.at("GRAY")).setOnClick(&gui::GUIButton::luminanceUp).buildButton();
-        auto luminanceDownButtonText = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(2, 5).setSize(40, 80).setFlags(false, false, true, false).setColor(gui::colorMap.at("WHITE")).setText(L"-").setFont(font1).setAutoScaleText(false).setTextScale(1.5f).buildText();
-        auto luminanceUpButtonText = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(1, 1).setSize(40, 60).setFlags(false, false, true, false).setColor(gui::colorMap.at("WHITE")).setText(L"+").setFont(font1).setAutoScaleText(false).buildText();
-
-        luminanceBase->addChild(luminanceText);
-        luminanceBase->addChild(luminanceUpButton);
-        luminanceBase->addChild(luminanceDownButton);
-        luminanceUpButton->addChild(luminanceUpButtonText);
-        luminanceDownButton->addChild(luminanceDownButtonText);
-
-        auto scaleBase = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(30, 210).setSize(200, 50).setFlags(false, false, true, true).buildElement();
-        auto scaleText = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(45, 0).setSize(110, 50).setFlags(false, false, true, false).setColor(gui::colorMap.at("WHITE")).setText(L"SCALE").setFont(font3).buildText();
-        auto scaleDownButton = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(5, 5).setSize(40, 40).setFlags(false, false, true, true).setColor(gui::colorMap.at("GRAY")).setOnClick(&gui::GUIButton::scaleDown).buildButton();
-        auto scaleUpButton = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(155, 5).setSize(40, 40).setFlags(false, false, true, true).setColor(gui::colorMap.at("GRAY")).setOnClick(&gui::GUIButton::scaleUp).buildButton();
-        auto scaleDownButtonText = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(2, 5).setSize(40, 80).setFlags(false, false, true, false).setColor(gui::colorMap.at("WHITE")).setText(L"-").setFont(font1).setAutoScaleText(false).setTextScale(1.5f).buildText();
-        auto scaleUpButtonText = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(1, 1).setSize(40, 60).setFlags(false, false, true, false).setColor(gui::colorMap.at("WHITE")).setText(L"+").setFont(font1).setAutoScaleText(false).buildText();
-
-        scaleBase->addChild(scaleText);
-        scaleBase->addChild(scaleUpButton);
-        scaleBase->addChild(scaleDownButton);
-        scaleUpButton->addChild(scaleUpButtonText);
-        scaleDownButton->addChild(scaleDownButtonText);
-
-        auto cameraSpeedBase = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(30, 270).setSize(200, 50).setFlags(false, false, true, true).buildElement();
-        auto cameraSpeedText = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(45, 0).setSize(110, 50).setFlags(false, false, true, false).setColor(gui::colorMap.at("WHITE")).setText(L"CAMERA\nSPEED").setFont(font3).buildText();
-        auto cameraSpeedDownButton = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(5, 5).setSize(40, 40).setFlags(false, false, true, true).setColor(gui::colorMap.at("GRAY")).setOnClick(&gui::GUIButton::cameraSpeedDown).buildButton();
-        auto cameraSpeedUpButton = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(155, 5).setSize(40, 40).setFlags(false, false, true, true).setColor(gui::colorMap.at("GRAY")).setOnClick(&gui::GUIButton::cameraSpeedUp).buildButton();
-        auto cameraSpeedDownButtonText = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(2, 5).setSize(40, 80).setFlags(false, false, true, false).setColor(gui::colorMap.at("WHITE")).setText(L"-").setFont(font1).setAutoScaleText(false).setTextScale(1.5f).buildText();
-        auto cameraSpeedUpButtonText = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(1, 1).setSize(40, 60).setFlags(false, false, true, false).setColor(gui::colorMap.at("WHITE")).setText(L"+").setFont(font1).setAutoScaleText(false).buildText();
-
-        cameraSpeedBase->addChild(cameraSpeedText);
-        cameraSpeedBase->addChild(cameraSpeedUpButton);
-        cameraSpeedBase->addChild(cameraSpeedDownButton);
-        cameraSpeedUpButton->addChild(cameraSpeedUpButtonText);
-        cameraSpeedDownButton->addChild(cameraSpeedDownButtonText);
-
-        auto nextModelButton = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(30, 330).setSize(200, 50).setFlags(false, false, true, true).setOnClick(&gui::GUIButton::nextModel).buildButton();
-        auto nextModelText = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(0, 0).setSize(200, 50).setFlags(false, false, true, false).setColor(gui::colorMap.at("WHITE")).setText(L"NEXT MODEL").setFont(font3).setPadding(10).buildText();
-
-        nextModelButton->addChild(nextModelText);
-
-        auto nextCubemapButton = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(30, 390).setSize(200, 50).setFlags(false, false, true, true).setOnClick(&gui::GUIButton::nextCubemap).buildButton();
-        auto nextCubemapText = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(0, 0).setSize(200, 50).setFlags(false, false, true, false).setColor(gui::colorMap.at("WHITE")).setText(L"NEXT CUBEMAP").setFont(font3).setPadding(10).buildText();
-
-        nextCubemapButton->addChild(nextCubemapText);
-
-        auto playgroundBase = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(240, 30).setSize(155, 35).setColor(gui::colorMap.at("BLUE")).buildElement();
-        auto playgroundChild = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(10, 10).setSize(155, 35).setFlags(false, false, true, false).setColor(gui::colorMap.at("RED")).buildElement();
-        auto playgroundChild2 = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(10, 10).setSize(155, 35).setFlags(false, false, true, false).setColor(gui::colorMap.at("YELLOW")).buildElement();
-        auto playgroundChild2GUIEditText = gui::GUIElementBuilder().setHandler(guiHandler).setPosition(0, 0).setSize(155, 35).setFlags(false, false, true, false).setColor(gui::colorMap.at("BLACK")).setText(L"PLAYGROUND").setFont(font2).buildEditText();
-
-        playgroundBase->addChild(playgroundChild);
-        playgroundChild->addChild(playgroundChild2);
-        playgroundChild2->addChild(playgroundChild2GUIEditText);
-
-        if (guiHandler->getZIndexRootElementMap().size() == 0)
+        // Pub-sub, each side only subscribes to the event types it has a handler for
+        for (size_t type = 0; type < (size_t)event::EventType::Count; ++type)
+        {
+            if (eventDispatcher.handles((event::EventType)type))
+            {
+                guiHandler->subscribe(this, (event::EventType)type);
+            }
+        }
+        this->subscribe(guiHandler, event::EventType::WindowResize);
+        // The GUI handles input on the render thread but SDL text input belongs to the main thread
+        guiHandler->setTextInputToggle([this](bool active)
+        {
+            postToSimulation([active]() { active ? SDL_StartTextInput() : SDL_StopTextInput(); });
+        });
+
+        // Controls are described in a layout file and built in one pass
+        gui::loadLayout(guiHandler, GUI_LAYOUT_PATH);
+
+        if (guiHandler->getRootElementCount() == 0)
         {
             std::cout << "Warning: guiHandler has no elements" << std::endl;
         }
@@ -509,65 +597,234 @@ namespace renderer
 
     void Renderer::run()
     {
-        const float MS_PER_UPDATE = (LOGIC_FREQ_HZ != 0 ? 
-                                    1000.0f / LOGIC_FREQ_HZ 
-                                    : 1000.0f / 60);
-        Uint32 previous = SDL_GetTicks();
-        float lag = 0.0;
+        const double SECONDS_PER_UPDATE = 1.0 / (options.simulationHz > 0 ? options.simulationHz : 60);
+        double previous = getSeconds();
+        double lag = 0.0;
+
+        // The render thread owns the context from here on, it is handed back when it exits
+        SDL_GL_MakeCurrent(window, nullptr);
+        CameraPose previousPose = getCameraPose();
+        publishSnapshot(previousPose, previous, SECONDS_PER_UPDATE);
+
+        // Keyframes are timed by the clock rather than by steps, in on-demand mode no steps run while idle
+        cameraRecordingStart = previous;
+        double lastKeyframeTime = previous;
+        if (!options.cameraRecordPath.empty())
+        {
+            recordCameraKeyframe(previous);
+        }
+        // Continuations posted by jobs have to wake the render thread in on-demand mode
+        jobs::getScheduler().setContinuationWake([this]() { requestRedraw(); });
+        renderThread = std::thread(&Renderer::renderLoop, this);
 
         float targetYaw = 0, targetPitch = 0;
         while (running) 
         {
-            Uint32 current = SDL_GetTicks();
-            Uint32 elapsed = current - previous;
+            // Sleep until input arrives or the next update is due, instead of spinning, in on-demand
+            // mode there are no updates to run while the camera is at rest so only input wakes it up
+            bool idle = options.onDemand && !isSimulationActive(targetYaw, targetPitch);
+            int timeoutMs = idle ? IDLE_WAIT_MS : std::max(1, (int)((SECONDS_PER_UPDATE - lag) * 1000.0));
+            SDL_Event event;
+            bool hasEvent = SDL_WaitEventTimeout(&event, timeoutMs) != 0;
+
+            double current = getSeconds();
+            lag = idle ? 0.0 : lag + (current - previous);
             previous = current;
-            lag += elapsed;
 
-            SDL_Event event;
-            while (SDL_PollEvent(&event))
+            // Consecutive motion events are merged into one before being handled, high polling rate
+            // mice can otherwise send many per frame and each one is hit tested by the GUI
+            SDL_Event pendingMotion;
+            bool hasPendingMotion = false;
+            for (; hasEvent; hasEvent = SDL_PollEvent(&event) != 0)
             {   
-                guiHandler->receiveInputAllElements(&event, &inputState);
+                if (event.type == SDL_MOUSEMOTION)
+                {
+                    if (hasPendingMotion)
+                    {
+                        pendingMotion.motion.xrel += event.motion.xrel;
+                        pendingMotion.motion.yrel += event.motion.yrel;
+                        pendingMotion.motion.x = event.motion.x;
+                        pendingMotion.motion.y = event.motion.y;
+                        pendingMotion.motion.state = event.motion.state;
+                        pendingMotion.motion.timestamp = event.motion.timestamp;
+                    }
+                    else
+                    {
+                        pendingMotion = event;
+                        hasPendingMotion = true;
+                    }
+                    continue;
+                }
 
-                if (event.type == SDL_QUIT) 
+                // Any other event ends the run of motion, keeping the order relative to button presses
+                if (hasPendingMotion)
                 {
-                    running = false;
+                    handleLiveEvent(pendingMotion, targetYaw, targetPitch);
+                    hasPendingMotion = false;
                 }
+                handleLiveEvent(event, targetYaw, targetPitch);
+            }
+            if (hasPendingMotion)
+            {
+                handleLiveEvent(pendingMotion, targetYaw, targetPitch);
+            }
+
+            std::vector<std::function<void()>> tasks;
+            {
+                std::lock_guard<std::mutex> lock(simulationTasksMutex);
+                tasks.swap(simulationTasks);
+            }
+            for (const auto& task : tasks)
+            {
+                task();
+            }
 
-                if (event.type == SDL_MOUSEMOTION) 
+            bool updated = !tasks.empty();
+            while (lag >= SECONDS_PER_UPDATE && running)
+            {
+                previousPose = getCameraPose();
+                if (replayer != nullptr)
                 {
-                    if (SDL_GetMouseState(NULL, NULL) & SDL_BUTTON(SDL_BUTTON_LEFT)
-                        && inputState.getMouseState() == InputState::CameraControl)
+                    if (!replayStep(targetYaw, targetPitch))
                     {
-                        targetYaw += event.motion.xrel * camera.horizontalMouseSensitivity;
-                        targetPitch -= event.motion.yrel * camera.verticalMouseSensitivity;
+                        std::cout << "Replay finished after " << simulationStep << " steps" << std::endl;
+                        running = false;
+                        break;
                     }
                 }
+                else
+                {
+                    onYawPitch(targetYaw, targetPitch, &inputState);
+                    onKeys(SDL_GetKeyboardState(NULL), &inputState);
+                }
+                lag -= SECONDS_PER_UPDATE;
+                ++simulationStep;
+                updated = true;
 
-                if (event.type == SDL_WINDOWEVENT) 
+                if (recorder != nullptr)
                 {
-                    if (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) 
-                    {
-                        int newWidth = event.window.data1;
-                        int newHeight = event.window.data2;
-                        glViewport(0, 0, newWidth, newHeight);
-                        this->publish(new event::WindowResizeEvent(newWidth, newHeight));
-                        WINDOW_WIDTH = (float)newWidth, WINDOW_HEIGHT = (float)newHeight;
-                    }
+                    recorder->recordTick(simulationStep, { camera.cameraPos, camera.targetPos, camera.cameraUp, camera.cameraYaw, camera.cameraPitch });
                 }
             }
 
-            while (lag >= MS_PER_UPDATE)
+            if (updated)
             {
-                onYawPitch(targetYaw, targetPitch, &inputState);
-                onKeys(SDL_GetKeyboardState(NULL), &inputState);
-                lag -= MS_PER_UPDATE;
+                // The latest step was due lag seconds ago, the render thread interpolates from there
+                publishSnapshot(previousPose, current - lag, SECONDS_PER_UPDATE);
             }
 
+            if (!options.cameraRecordPath.empty() && current - lastKeyframeTime >= 1.0 / CAMERA_KEYFRAMES_PER_SECOND)
+            {
+                recordCameraKeyframe(current);
+                lastKeyframeTime = current;
+            }
+        }
+
+        requestRedraw(); // Wakes the render thread so it sees running is false
+        renderThread.join();
+        jobs::getScheduler().setContinuationWake(nullptr);
+        SDL_GL_MakeCurrent(window, context); // For the clean-up in the destructor
+
+        if (!options.cameraRecordPath.empty())
+        {
+            recordCameraKeyframe(getSeconds()); // Where the camera ended up
+            if (cameraRecording.save(options.cameraRecordPath))
+            {
+                std::cout << "Recorded " << cameraRecording.getKeyframeCount() << " camera keyframes to " << options.cameraRecordPath << std::endl;
+            }
+        }
+
+        if (reportEnabled)
+        {
+            report.sampleMemory("at_exit");
+            report.print(std::cout);
+            if (!options.reportPath.empty())
+            {
+                report.write(options.reportPath, targetGLTFpath.string(), targetCubemapPath.string());
+            }
+        }
+
+        EventQueue<event::EventRecord>::Stats postedStats = postedEvents.getStats();
+        if (postedStats.overflows > 0)
+        {
+            std::cerr << "Event queue overflowed " << postedStats.overflows << " times, " << postedStats.pushed << " events were posted" << std::endl;
+        }
+    }
+
+    void Renderer::renderLoop()
+    {
+        SDL_GL_MakeCurrent(window, context);
+        // Paced by vsync and/or the limiter, input keeps being handled on the main thread meanwhile
+        SDL_GL_SetSwapInterval(options.vsync ? 1 : 0);
+        FrameLimiter limiter(options.maxFps);
+        frameTimer.markFrameStart(); // The first frame should not count the loading
+        unsigned long long frameIndex = 0;
+        double playbackStart = getSeconds();
+        float pathSpeed = -1.0f; // Last speed handed to the simulation while playing the camera path
+
+        std::vector<SDL_Event> events;
+        while (running)
+        {
+            if (options.onDemand)
+            {
+                waitForRedraw();
+                if (!running)
+                {
+                    break;
+                }
+                frameTimer.markFrameStart();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(renderEventsMutex);
+                events.swap(renderEvents);
+            }
+            for (const SDL_Event& event : events)
+            {
+                handleRenderEvent(event);
+            }
+            events.clear();
+
+            // Work the job scheduler's jobs handed back to the thread owning the context
+            jobs::getScheduler().runContinuations();
+
+            // Keeps drawing the previous snapshot if the simulation has not published a new one
+            snapshots.acquire();
+            const FrameSnapshot& snapshot = snapshots.getReadSlot();
+
+            if (replayer != nullptr)
+            {
+                applyReplayedEvents(snapshot.simulationStep);
+            }
+            drainPostedEvents();
+            processDeferredEvents();
+
             glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-            viewMatrix = glm::lookAt(camera.cameraPos, camera.targetPos, camera.cameraUp);
+            double frameTime = getSeconds();
+            CameraPose pose = snapshot.interpolate(frameTime);
+
+            // The path overrides the simulation's camera, tied to the frame index the same frames see the same poses
+            bool pathFinished = false;
+            if (!cameraPath.isEmpty())
+            {
+                double pathTime = options.pathFps > 0 ? frameIndex / (double)options.pathFps : frameTime - playbackStart;
+                CameraKeyframe keyframe = cameraPath.evaluate(pathTime);
+                pose.cameraPos = keyframe.position;
+                pose.targetPos = keyframe.position + getLookDirection(keyframe.yaw, keyframe.pitch);
+                pathFinished = pathTime >= cameraPath.getDuration();
+
+                // The camera speed belongs to the main thread, only handed over when it changes
+                if (keyframe.speed != pathSpeed)
+                {
+                    pathSpeed = keyframe.speed;
+                    postToSimulation([this, pathSpeed]() { camera.cameraSpeed = pathSpeed; });
+                }
+            }
+            viewMatrix = glm::lookAt(pose.cameraPos, pose.targetPos, pose.cameraUp);
             projMatrix = glm::perspective(FOV, WINDOW_WIDTH / WINDOW_HEIGHT, NEAR_DIST, FAR_DIST); // Just in case of window resize
+            updateFrameConstants();
 
             drawSkybox();
 
@@ -575,8 +832,275 @@ namespace renderer
 
             guiHandler->renderAllElements();
 
+            frameTimer.markWorkDone();
+            limiter.wait();
             SDL_GL_SwapWindow(window);
+            frameTimer.markFrameEnd();
+            ++frameIndex;
+
+            if (reportEnabled)
+            {
+                FrameStats stats = frameTimer.getStats();
+                report.addFrame(stats.frameMs, stats.workMs, drawCommands.size());
+                if (options.frameCount > 0 && stats.frameCount >= (unsigned long long)options.frameCount)
+                {
+                    quit();
+                }
+            }
+
+            if (pathFinished)
+            {
+                std::cout << "Camera path finished after " << frameIndex << " frames" << std::endl;
+                quit();
+            }
+
+            // Keep going while the camera is still between steps or moving along the path, or events were left for the next frame
+            if (options.onDemand && (!snapshot.isSettled(frameTime) || !cameraPath.isEmpty() || !deferredEvents.isEmpty()))
+            {
+                requestRedraw();
+            }
+        }
+
+        SDL_GL_MakeCurrent(window, nullptr);
+    }
+
+    void Renderer::requestRedraw()
+    {
+        {
+            std::lock_guard<std::mutex> lock(redrawMutex);
+            redrawRequested = true;
+        }
+        redrawCondition.notify_one();
+    }
+
+    void Renderer::waitForRedraw()
+    {
+        // A blinking cursor only needs a frame when it toggles
+        auto nextAnimationTime = guiHandler->getNextAnimationTime();
+
+        std::unique_lock<std::mutex> lock(redrawMutex);
+        auto isRequested = [this]() { return redrawRequested || !running; };
+        if (nextAnimationTime == std::chrono::steady_clock::time_point::max())
+        {
+            redrawCondition.wait(lock, isRequested);
+        }
+        else
+        {
+            redrawCondition.wait_until(lock, nextAnimationTime, isRequested);
+        }
+        redrawRequested = false;
+    }
+
+    void Renderer::wakeSimulation()
+    {
+        // Any event ends the wait in run, user events are otherwise ignored
+        SDL_Event wakeEvent = {};
+        wakeEvent.type = SDL_USEREVENT;
+        SDL_PushEvent(&wakeEvent);
+    }
+
+    bool Renderer::isSimulationActive(float targetYaw, float targetPitch) const
+    {
+        if (replayer != nullptr)
+        {
+            return true; // Ticks have to keep coming
         }
+
+        // onYawPitch is still converging towards the target
+        const float EPSILON = 1e-4f;
+        float clampedTargetPitch = glm::clamp(targetPitch, glm::radians(-89.0f), glm::radians(89.0f));
+        if (inputState.getMouseState() == InputState::CameraControl
+            && (std::abs(targetYaw - camera.cameraYaw) > EPSILON || std::abs(clampedTargetPitch - camera.cameraPitch) > EPSILON))
+        {
+            return true;
+        }
+
+        // A movement key is held
+        const Uint8* keyboardState = SDL_GetKeyboardState(NULL);
+        return inputState.getKeyboardState() == InputState::MovementControl
+            && (keyboardState[SDL_SCANCODE_W] || keyboardState[SDL_SCANCODE_S] || keyboardState[SDL_SCANCODE_A]
+                || keyboardState[SDL_SCANCODE_D] || keyboardState[SDL_SCANCODE_LSHIFT] || keyboardState[SDL_SCANCODE_LCTRL]);
+    }
+
+    void Renderer::handleLiveEvent(const SDL_Event& event, float& targetYaw, float& targetPitch)
+    {
+        // While replaying only the recorded events are handled, apart from closing the window
+        if (replayer != nullptr)
+        {
+            if (event.type == SDL_QUIT)
+            {
+                running = false;
+            }
+            return;
+        }
+
+        if (recorder != nullptr)
+        {
+            recorder->recordSDLEvent(simulationStep, event);
+        }
+        handleEvent(event, targetYaw, targetPitch);
+    }
+
+    bool Renderer::replayStep(float& targetYaw, float& targetPitch)
+    {
+        // Everything recorded before the step, up to and including its tick
+        while (const session::SessionRecord* record = replayer->next())
+        {
+            switch (record->kind)
+            {
+            case session::RecordKind::SDLEvent:
+                handleEvent(record->sdlEvent, targetYaw, targetPitch);
+                break;
+            case session::RecordKind::PublishedEvent:
+            {
+                // Queued before the snapshot of the next step is published, so the render thread has it by then
+                std::lock_guard<std::mutex> lock(replayedEventsMutex);
+                replayedEvents.push_back({ record->step, record->event });
+                break;
+            }
+            case session::RecordKind::Tick:
+                // The camera is taken from the recording rather than simulated, camera changes made on the
+                // render thread (e.g. speed buttons) reach the simulation asynchronously and could land on another step
+                camera.cameraPos = record->camera.cameraPos;
+                camera.targetPos = record->camera.targetPos;
+                camera.cameraUp = record->camera.cameraUp;
+                camera.cameraYaw = record->camera.cameraYaw;
+                camera.cameraPitch = record->camera.cameraPitch;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Renderer::handleEvent(const SDL_Event& event, float& targetYaw, float& targetPitch)
+    {
+        // The GUI and everything depending on the window size belong to the render thread
+        if (guiHandler->handlesEventType(event.type) || event.type == SDL_WINDOWEVENT)
+        {
+            {
+                std::lock_guard<std::mutex> lock(renderEventsMutex);
+                renderEvents.emplace_back(event);
+            }
+            requestRedraw();
+        }
+
+        if (event.type == SDL_QUIT) 
+        {
+            running = false;
+        }
+
+        if (event.type == SDL_MOUSEMOTION) 
+        {
+            // Button state from the event rather than SDL_GetMouseState, so replayed events behave the same
+            if (event.motion.state & SDL_BUTTON_LMASK
+                && inputState.getMouseState() == InputState::CameraControl)
+            {
+                targetYaw += event.motion.xrel * camera.horizontalMouseSensitivity;
+                targetPitch -= event.motion.yrel * camera.verticalMouseSensitivity;
+            }
+        }
+    }
+
+    void Renderer::handleRenderEvent(const SDL_Event& event)
+    {
+        if (guiHandler->handlesEventType(event.type))
+        {
+            guiHandler->receiveInputAllElements(&event, &inputState);
+        }
+
+        if (event.type == SDL_WINDOWEVENT) 
+        {
+            if (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) 
+            {
+                int newWidth = event.window.data1;
+                int newHeight = event.window.data2;
+                glViewport(0, 0, newWidth, newHeight);
+                this->publish(event::WindowResizeEvent(newWidth, newHeight));
+                WINDOW_WIDTH = (float)newWidth, WINDOW_HEIGHT = (float)newHeight;
+            }
+        }
+    }
+
+    void Renderer::postToSimulation(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(simulationTasksMutex);
+            simulationTasks.emplace_back(std::move(task));
+        }
+        if (options.onDemand)
+        {
+            wakeSimulation();
+        }
+    }
+
+    void Renderer::drainPostedEvents()
+    {
+        // At most one queue's worth, events posted while draining wait for the next frame
+        event::EventRecord record;
+        for (size_t i = 0; i < postedEvents.getCapacity() && postedEvents.tryPop(record); ++i)
+        {
+            const event::Event& event = record.get();
+            deliverEvent(&event);
+            publish(event);
+        }
+    }
+
+    void Renderer::applyReplayedEvents(unsigned long long snapshotStep)
+    {
+        std::vector<event::EventRecord> due;
+        {
+            std::lock_guard<std::mutex> lock(replayedEventsMutex);
+            while (!replayedEvents.empty() && replayedEvents.front().step < snapshotStep)
+            {
+                due.emplace_back(replayedEvents.front().event);
+                replayedEvents.pop_front();
+            }
+        }
+
+        // Not deferred, the frame budget would otherwise decide which frame they land on
+        for (const event::EventRecord& record : due)
+        {
+            const event::Event& event = record.get();
+            eventDispatcher.dispatch(&event);
+            publish(event);
+        }
+    }
+
+    void Renderer::publishSnapshot(const CameraPose& previousPose, double stepTime, double stepDuration)
+    {
+        FrameSnapshot& snapshot = snapshots.getWriteSlot();
+        snapshot.previous = previousPose;
+        snapshot.current = getCameraPose();
+        snapshot.stepTime = stepTime;
+        snapshot.stepDuration = stepDuration;
+        snapshot.simulationStep = simulationStep;
+        snapshots.publish();
+        requestRedraw();
+    }
+
+    CameraPose Renderer::getCameraPose() const
+    {
+        CameraPose pose;
+        pose.cameraPos = camera.cameraPos;
+        pose.targetPos = camera.targetPos;
+        pose.cameraUp = camera.cameraUp;
+        return pose;
+    }
+
+    void Renderer::recordCameraKeyframe(double now)
+    {
+        double time = now - cameraRecordingStart;
+
+        // From where the camera actually looks, cameraYaw and cameraPitch only match it once the mouse moved it
+        glm::vec3 lookDir = glm::normalize(camera.targetPos - camera.cameraPos);
+        float yaw = std::atan2(lookDir.z, lookDir.x);
+        float pitch = std::asin(glm::clamp(lookDir.y, -1.0f, 1.0f));
+        cameraRecording.addKeyframe({ time, camera.cameraPos, yaw, pitch, camera.cameraSpeed });
+    }
+
+    FrameStats Renderer::getFrameStats() const
+    {
+        return frameTimer.getStats();
     }
 
     void Renderer::onYawPitch(float targetYaw, float targetPitch, InputState* inputState) 
@@ -600,11 +1124,7 @@ namespace renderer
         }
 
         // Calculate the new look direction
-        glm::vec3 newLookDir;
-        newLookDir.x = cos(camera.cameraYaw) * cos(camera.cameraPitch);
-        newLookDir.y = sin(camera.cameraPitch);
-        newLookDir.z = sin(camera.cameraYaw) * cos(camera.cameraPitch);
-        camera.lookDir = glm::normalize(newLookDir);
+        camera.lookDir = getLookDirection(camera.cameraYaw, camera.cameraPitch);
 
         // Update target position based on new look direction and camera position
         camera.targetPos = camera.cameraPos + camera.lookDir;
@@ -660,6 +1180,18 @@ namespace renderer
         }
     }
 
+    void Renderer::updateFrameConstants()
+    {
+        shaders::FrameConstants frameConstants = {};
+        frameConstants.view = viewMatrix;
+        frameConstants.projection = projMatrix;
+        frameConstants.ortho = glm::ortho(0.0f, WINDOW_WIDTH, 0.0f, WINDOW_HEIGHT);
+        frameConstants.viewport = glm::vec4(0.0f, 0.0f, WINDOW_WIDTH, WINDOW_HEIGHT);
+        frameConstants.time = (float)SDL_GetTicks() / 1000.0f;
+
+        shaders::updateFrameConstants(frameConstantsUBO, frameConstants);
+    }
+
     void Renderer::drawModel()
     {
         // Use the shader program
@@ -694,73 +1226,275 @@ namespace renderer
             glUniform1i(applyOcclusionLoc, applyOcclusion);
         }
 
-        // Draw model by initiating recursive drawNode calls
-        if (targetGLTFmodel.defaultScene >= 0) 
+        // Transforms, culling and sort keys are computed by the job scheduler's workers, each job records the
+        // subtrees it was given into its own command list, this thread only merges, sorts and submits
+        prepareDrawRoots();
+        drawCommandLists.resize(drawRoots.size());
+        jobs::getScheduler().parallelFor(0, drawRoots.size(), 1, [this](size_t begin, size_t end)
         {
-            for (const auto nodeIdx : targetGLTFmodel.scenes[targetGLTFmodel.defaultScene].nodes) 
+            for (size_t i = begin; i < end; ++i)
             {
-                drawNode(nodeIdx, glm::mat4(1), true);
+                drawCommandLists[i].clear();
+                const DrawRoot& root = drawRoots[i];
+                recordNode(root.nodeIdx, root.parentMatrix, root.isRoot, root.recordChildren, drawCommandLists[i]);
             }
+        });
+
+        drawCommands.clear();
+        for (size_t i = 0; i < drawRoots.size(); ++i)
+        {
+            drawCommands.insert(drawCommands.end(), drawCommandLists[i].begin(), drawCommandLists[i].end());
         }
+        std::sort(drawCommands.begin(), drawCommands.end(), [](const DrawCommand& a, const DrawCommand& b) { return a.sortKey < b.sortKey; });
+
+        submitDrawCommands();
     }
 
-    void Renderer::drawNode(int nodeIdx, const glm::mat4 parentMatrix, bool isRoot)
+    void Renderer::prepareDrawRoots()
     {
-        const auto& node = targetGLTFmodel.nodes[nodeIdx];
-        glm::mat4 modelMatrix = utilgltf::getLocalToWorldMatrix(node, parentMatrix);
+        drawRoots.clear();
+        if (targetGLTFmodel.defaultScene < 0) 
+        {
+            return;
+        }
+
+        for (const auto nodeIdx : targetGLTFmodel.scenes[targetGLTFmodel.defaultScene].nodes) 
+        {
+            drawRoots.push_back({ nodeIdx, glm::mat4(1), true, true });
+        }
 
+        // Scenes often have a single root with everything below it, so subtrees are split up level by level until
+        // there are enough to keep every worker busy, an expanded node only records its own meshes
+        const size_t targetRootCount = 4 * ((size_t)jobs::getScheduler().getWorkerCount() + 1);
+        size_t expandBegin = 0;
+        while (drawRoots.size() < targetRootCount && expandBegin < drawRoots.size())
+        {
+            size_t expandEnd = drawRoots.size();
+            for (size_t i = expandBegin; i < expandEnd; ++i)
+            {
+                const auto& node = targetGLTFmodel.nodes[drawRoots[i].nodeIdx];
+                if (node.children.empty() || !drawRoots[i].recordChildren)
+                {
+                    continue;
+                }
+
+                glm::mat4 modelMatrix = getNodeMatrix(node, drawRoots[i].parentMatrix, drawRoots[i].isRoot);
+                drawRoots[i].recordChildren = false;
+                for (const auto childNodeIdx : node.children)
+                {
+                    drawRoots.push_back({ childNodeIdx, modelMatrix, false, true });
+                }
+            }
+            expandBegin = expandEnd;
+        }
+    }
+
+    glm::mat4 Renderer::getNodeMatrix(const tinygltf::Node& node, const glm::mat4& parentMatrix, bool isRoot) const
+    {
+        glm::mat4 modelMatrix = utilgltf::getLocalToWorldMatrix(node, parentMatrix);
         if (isRoot) // Apply scale factor to the model at the root level only
         {
             modelMatrix = glm::scale(modelMatrix, glm::vec3(scaleFactor));
         }
+        return modelMatrix;
+    }
+
+    // Conservative test against the view frustum, false only if all corners of the box are outside the same clip plane
+    static bool isBoxInFrustum(const glm::mat4& mvpMatrix, const utilgltf::MeshBounds& bounds)
+    {
+        if (!bounds.valid)
+        {
+            return true;
+        }
+
+        int outside[6] = { 0, 0, 0, 0, 0, 0 };
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            glm::vec4 clip = mvpMatrix * glm::vec4(
+                corner & 1 ? bounds.max.x : bounds.min.x,
+                corner & 2 ? bounds.max.y : bounds.min.y,
+                corner & 4 ? bounds.max.z : bounds.min.z,
+                1.0f);
+            outside[0] += clip.x < -clip.w;
+            outside[1] += clip.x > clip.w;
+            outside[2] += clip.y < -clip.w;
+            outside[3] += clip.y > clip.w;
+            outside[4] += clip.z < -clip.w;
+            outside[5] += clip.z > clip.w;
+        }
+
+        for (int plane = 0; plane < 6; ++plane)
+        {
+            if (outside[plane] == 8)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void Renderer::recordNode(int nodeIdx, const glm::mat4& parentMatrix, bool isRoot, bool recordChildren, std::vector<DrawCommand>& commands) const
+    {
+        const auto& node = targetGLTFmodel.nodes[nodeIdx];
+        glm::mat4 modelMatrix = getNodeMatrix(node, parentMatrix, isRoot);
 
         // If the node references a mesh (a node can also reference a
         // camera, or a light)
         if (node.mesh >= 0) 
         {
             const auto mvMatrix = viewMatrix * modelMatrix; // Also called localToCamera matrix
-            const auto mvpMatrix = projMatrix * mvMatrix; // Also called localToScreen matrix
-            // Normal matrix is necessary to maintain normal vectors
-            // orthogonal to tangent vectors
-            // https://www.lighthouse3d.com/tutorials/glsl-12-tutorial/the-normal-matrix/
-            const auto normalMatrix = glm::transpose(glm::inverse(mvMatrix));
+            if (isBoxInFrustum(projMatrix * mvMatrix, meshBounds[node.mesh]))
+            {
+                // Normal matrix is necessary to maintain normal vectors
+                // orthogonal to tangent vectors
+                // https://www.lighthouse3d.com/tutorials/glsl-12-tutorial/the-normal-matrix/
+                const auto normalMatrix = glm::transpose(glm::inverse(mvMatrix));
+
+                const auto& mesh = targetGLTFmodel.meshes[node.mesh];
+                const auto& vaoRange = meshToVertexArrays[node.mesh];
+                for (size_t pIdx = 0; pIdx < mesh.primitives.size(); ++pIdx) 
+                {
+                    const auto &primitive = mesh.primitives[pIdx];
+
+                    DrawCommand command;
+                    command.mvMatrix = mvMatrix;
+                    command.normalMatrix = normalMatrix;
+                    command.material = primitive.material;
+                    command.vao = VAOs[vaoRange.begin + pIdx];
+                    command.mode = primitive.mode;
+                    if (primitive.indices >= 0) 
+                    {
+                        const auto& accessor = targetGLTFmodel.accessors[primitive.indices];
+                        const auto& bufferView = targetGLTFmodel.bufferViews[accessor.bufferView];
+                        command.count = GLsizei(accessor.count);
+                        command.indexType = accessor.componentType;
+                        command.indexByteOffset = accessor.byteOffset + bufferView.byteOffset;
+                    } 
+                    else 
+                    {
+                        // Take first accessor to get the count
+                        const auto accessorIdx = (*begin(primitive.attributes)).second;
+                        command.count = GLsizei(targetGLTFmodel.accessors[accessorIdx].count);
+                        command.indexType = 0;
+                        command.indexByteOffset = 0;
+                    }
+                    // Draws sharing a material end up next to each other, so it is only bound once for all of them
+                    command.sortKey = ((uint64_t)(uint32_t)(primitive.material + 1) << 32) | command.vao;
 
-            glUniformMatrix4fv(modelViewProjMatrixLoc, 1, GL_FALSE, glm::value_ptr(mvpMatrix));
-            glUniformMatrix4fv(modelViewMatrixLoc, 1, GL_FALSE, glm::value_ptr(mvMatrix));
-            glUniformMatrix4fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+                    commands.emplace_back(command);
+                }
+            }
+        }
 
-            const auto& mesh = targetGLTFmodel.meshes[node.mesh];
-            const auto& vaoRange = meshToVertexArrays[node.mesh];
-            for (size_t pIdx = 0; pIdx < mesh.primitives.size(); ++pIdx) 
+        if (recordChildren)
+        {
+            for (const auto childNodeIdx : node.children) 
             {
-                const auto vao = VAOs[vaoRange.begin + pIdx];
-                const auto &primitive = mesh.primitives[pIdx];
+                recordNode(childNodeIdx, modelMatrix, false, true, commands);
+            }
+        }
+    }
 
-                bindMaterial(primitive.material);
+    void Renderer::submitDrawCommands()
+    {
+        if (drawCommands.empty())
+        {
+            return;
+        }
+        if (drawCommands.size() > drawDataCapacity)
+        {
+            reserveDrawData(drawCommands.size());
+            if (drawCommands.size() > drawDataCapacity)
+            {
+                return; // Could not map the buffer, already reported by StreamBuffer::create
+            }
+        }
 
-                glBindVertexArray(vao);
-                if (primitive.indices >= 0) 
-                {
-                    const auto& accessor = targetGLTFmodel.accessors[primitive.indices];
-                    const auto& bufferView = targetGLTFmodel.bufferViews[accessor.bufferView];
-                    const auto byteOffset = accessor.byteOffset + bufferView.byteOffset;
-                    glDrawElements(primitive.mode, GLsizei(accessor.count), accessor.componentType, (const GLvoid *)byteOffset);
-                } 
-                else 
-                {
-                    // Take first accessor to get the count
-                    const auto accessorIdx = (*begin(primitive.attributes)).second;
-                    const auto& accessor = targetGLTFmodel.accessors[accessorIdx];
-                    glDrawArrays(primitive.mode, 0, GLsizei(accessor.count));
-                }
+        // Only waits if the GPU is still FRAMES_IN_FLIGHT frames behind
+        shaders::DrawData* drawData = (shaders::DrawData*)drawDataBuffer.beginFrame();
+        for (size_t i = 0; i < drawCommands.size(); ++i)
+        {
+            drawData[i].modelView = drawCommands[i].mvMatrix;
+            drawData[i].normal = drawCommands[i].normalMatrix;
+        }
+        drawDataBuffer.bindRegion(shaders::DRAW_DATA_BINDING);
+
+        int boundMaterial = INT_MIN;
+        for (size_t i = 0; i < drawCommands.size(); ++i)
+        {
+            const DrawCommand& command = drawCommands[i];
+            if (command.material != boundMaterial)
+            {
+                bindMaterial(command.material);
+                boundMaterial = command.material;
+            }
+
+            // A single instance whose base instance is the draw's index, so the draw id attribute reads i
+            glBindVertexArray(command.vao);
+            if (command.indexType != 0) 
+            {
+                glDrawElementsInstancedBaseInstance(command.mode, command.count, command.indexType, (const GLvoid *)command.indexByteOffset, 1, (GLuint)i);
+            } 
+            else 
+            {
+                glDrawArraysInstancedBaseInstance(command.mode, 0, command.count, 1, (GLuint)i);
             }
         }
 
-        // Draw children
-        for (const auto childNodeIdx : node.children) 
+        drawDataBuffer.endFrame();
+    }
+
+    void Renderer::reserveDrawData(size_t drawCount)
+    {
+        size_t capacity = std::max(drawDataCapacity, INITIAL_DRAW_DATA_CAPACITY);
+        while (capacity < drawCount)
+        {
+            capacity *= 2;
+        }
+        if (capacity == drawDataCapacity)
+        {
+            return;
+        }
+
+        // destroy waits for the GPU to be done with every region, only happens when the model gets bigger
+        if (!drawDataBuffer.create(GL_SHADER_STORAGE_BUFFER, GLsizeiptr(capacity * sizeof(shaders::DrawData))))
+        {
+            drawDataCapacity = 0;
+            return;
+        }
+        drawDataCapacity = capacity;
+
+        std::vector<GLuint> drawIds(capacity);
+        for (size_t i = 0; i < capacity; ++i)
+        {
+            drawIds[i] = (GLuint)i;
+        }
+        glDeleteBuffers(1, &drawIdVBO);
+        glGenBuffers(1, &drawIdVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, drawIdVBO);
+        glBufferStorage(GL_ARRAY_BUFFER, GLsizeiptr(drawIds.size() * sizeof(GLuint)), drawIds.data(), 0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        attachDrawIds();
+    }
+
+    void Renderer::attachDrawIds()
+    {
+        if (drawIdVBO == 0)
+        {
+            return;
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, drawIdVBO);
+        for (const auto VAO : VAOs)
         {
-            drawNode(childNodeIdx, modelMatrix);
+            glBindVertexArray(VAO);
+            glEnableVertexAttribArray(shaders::VERTEX_ATTRIB_DRAW_ID_IDX);
+            glVertexAttribIPointer(shaders::VERTEX_ATTRIB_DRAW_ID_IDX, 1, GL_UNSIGNED_INT, 0, (const GLvoid *)0);
+            glVertexAttribDivisor(shaders::VERTEX_ATTRIB_DRAW_ID_IDX, 1);
         }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
     }
 
     void Renderer::bindMaterial(const int materialIndex)
@@ -924,9 +1658,6 @@ namespace renderer
 
         glUseProgram(shaderProgramSkybox);  // Use skybox shader
 
-        glUniformMatrix4fv(viewSkyboxLoc, 1, GL_FALSE, glm::value_ptr(glm::mat4(glm::mat3(viewMatrix))));
-        glUniformMatrix4fv(projectionSkyboxLoc, 1, GL_FALSE, glm::value_ptr(projMatrix));
-
         glBindVertexArray(skyboxVAO);
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_CUBE_MAP, targetCubemap.textureID);
@@ -1120,7 +1851,11 @@ namespace renderer
 
         initializeModel();
 
-        camera.cameraPos = glm::vec3(0, 0, 5);
-        camera.targetPos = glm::vec3(0, 0, 0);
+        // The camera belongs to the main thread
+        postToSimulation([this]()
+        {
+            camera.cameraPos = glm::vec3(0, 0, 5);
+            camera.targetPos = glm::vec3(0, 0, 0);
+        });
     }
 }
\ No newline at end of file
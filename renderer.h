@@ -15,7 +15,19 @@
 #include <unordered_map>
 #include <array>
 #include <deque>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
 
+#include "frame_snapshot.h"
+#include "frame_timing.h"
+#include "event_queue.h"
+#include "stream_buffer.h"
+#include "run_report.h"
+#include "camera_path.h"
+#include "session_log.h"
 #include "input_state.h"
 #include "pub_sub.h"
 #include "tiny_gltf.h"
@@ -39,12 +51,56 @@ namespace renderer
         const float smoothingFactor = 0.1f; // Lower value means more smoothing
     };
 
+    // Everything needed to draw one primitive, recorded off the GL thread
+    struct DrawCommand
+    {
+        uint64_t sortKey; // Material in the high bits, then VAO
+        glm::mat4 mvMatrix;
+        glm::mat4 normalMatrix;
+        int material;
+        GLuint vao;
+        GLenum mode;
+        GLsizei count;
+        GLenum indexType; // 0 for non-indexed draws
+        size_t indexByteOffset;
+    };
+
+    // A node whose subtree is recorded by one job
+    struct DrawRoot
+    {
+        int nodeIdx;
+        glm::mat4 parentMatrix;
+        bool isRoot; // A root of the scene, where the scale factor is applied
+        bool recordChildren; // False if the children were split off into their own DrawRoots
+    };
+
     struct CubeMap
     {
         GLuint textureID;
         std::filesystem::path path;
     };
 
+    struct RendererOptions
+    {
+        std::string recordPath; // Records the session to this file if set
+        std::string replayPath; // Replays the session in this file instead of taking input if set
+        bool hidden = false; // Creates the window hidden, e.g. for unattended replays
+        int simulationHz = 60; // Rate of the fixed camera updates, rendering interpolates between them
+        int maxFps = 0; // Frame rate cap on top of vsync, 0 for none
+        bool vsync = true;
+        // Only draws a frame when something changed (input, camera motion, events, GUI animations) instead of continuously
+        bool onDemand = false;
+        std::string modelFile; // File name in MODELS_PATH or path of a .glb/.gltf file, instead of the default model
+        std::string cubemapFile; // Folder name in CUBEMAPS_PATH, instead of the default cubemap
+        int windowWidth = 0, windowHeight = 0; // 0 sizes the window from the display
+        int msaaSamples = 4; // 0 disables multisampling
+        int frameCount = 0; // Quits after this many frames, 0 to run until closed
+        std::string reportPath; // Writes the run report as JSON to this file if set
+        std::string cameraRecordPath; // Records camera keyframes to this file if set
+        std::string cameraPathFile; // Flies the camera along the keyframes in this file instead of taking camera input if set
+        int pathFps = 0; // Advances camera path playback by 1 / pathFps seconds per frame instead of by real time, 0 for real time
+    };
+
     enum RendererState
     {
         RENDERER_CREATED,
@@ -59,11 +115,22 @@ namespace renderer
     public:
         RendererState RENDERER_STATE;
 
-        Renderer();
+        Renderer(const RendererOptions& options = RendererOptions());
         ~Renderer();
 
         void notify(const event::Event* event) override;
         void quit();
+        // Timing of the most recent frames on the render thread, can be called from any thread
+        FrameStats getFrameStats() const;
+        // Queues a copy of event from any thread, it is delivered to the renderer and its subscribers on the render
+        // thread at the start of the next frame, returns false if the queue is full and the event was not queued
+        template<typename T>
+        bool postEvent(const T& event)
+        {
+            bool pushed = postedEvents.tryPush(event::EventRecord(event));
+            requestRedraw();
+            return pushed;
+        }
 
     private:
         bool SDL_GLAD_init(SDL_Window** window, SDL_GLContext* context);
@@ -71,19 +138,70 @@ namespace renderer
         bool initializeShaders(); 
         bool initializeCubemaps();
         bool initializeGUI();
+        // Runs initialize, adding its duration to report under stage
+        bool timeLoad(const std::string& stage, bool (Renderer::*initialize)());
+        // Opens the session log for recording or replaying and loads the camera path, if requested in options
+        bool initializeSession();
+        // Fills eventDispatcher with a handler for each event type the renderer reacts to
+        void registerEventHandlers();
 
-        // Main event loop
+        // Main event loop, runs input and the fixed-step camera updates on the main thread
+        // while a render thread started here owns the GL context and draws
         void run();
+        void renderLoop();
+        // Records event or, while replaying, drops it, then passes it on to handleEvent
+        void handleLiveEvent(const SDL_Event& event, float& targetYaw, float& targetPitch);
+        // Handles the recorded events up to the next tick and sets the camera from it,
+        // returns false once the recording is exhausted
+        bool replayStep(float& targetYaw, float& targetPitch);
+        // Handles event on the main thread, events for the GUI or the window are queued for the render thread
+        void handleEvent(const SDL_Event& event, float& targetYaw, float& targetPitch);
+        void handleRenderEvent(const SDL_Event& event);
+        // Runs task on the main thread before its next update, for changes from the render thread to simulation state
+        void postToSimulation(std::function<void()> task);
+        // Wakes the render thread in on-demand mode, can be called from any thread
+        void requestRedraw();
+        // Blocks the render thread until requestRedraw is called or a GUI animation is due
+        void waitForRedraw();
+        // Ends the main thread's wait for input, for when the render thread needs it to run
+        void wakeSimulation();
+        // Whether a fixed update would change the camera, otherwise the main thread can idle in on-demand mode
+        bool isSimulationActive(float targetYaw, float targetPitch) const;
+        // Publishes the camera moving from previousPose to the current camera over the step due at stepTime
+        void publishSnapshot(const CameraPose& previousPose, double stepTime, double stepDuration);
+        CameraPose getCameraPose() const;
+        // Adds the camera's current state at now (from getSeconds) to cameraRecording, on the main thread
+        void recordCameraKeyframe(double now);
+        // Delivers the events queued with postEvent, called once per frame on the render thread
+        void drainPostedEvents();
+        // Applies the replayed events recorded before snapshotStep, right away rather than deferred
+        void applyReplayedEvents(unsigned long long snapshotStep);
+        // Handles the events coalesced in deferredEvents within DEFERRED_EVENTS_BUDGET_MS, called once per frame after
+        // drainPostedEvents, only one heavy event (model or cubemap reload) is handled per frame
+        void processDeferredEvents();
+        // Handles event right away or queues it in deferredEvents
+        void deliverEvent(const event::Event* event);
         // Update the camera's yaw and pitch to smoothly move towards the target yaw and pitch
         void onYawPitch(float targetYaw, float targetPitch, InputState* inputState);
         // Update the camera's position based on keyboard input
         void onKeys(const Uint8* keyboardState, InputState* inputState);
 
-        // Draws each node of the model by calling drawNode
+        // Uploads the view, projection and time shared by all shaders, once per frame
+        void updateFrameConstants();
+        // Records a DrawCommand for each visible primitive of the model in parallel, then submits them sorted by material
         void drawModel();
-        // Recursively draw node and its children at nodeIdx, binds
-        // materials for each primitive in the mesh of the node
-        void drawNode(int nodeIdx, const glm::mat4 parentMatrix, bool isRoot = false);
+        // Fills drawRoots with the subtrees recorded by separate jobs
+        void prepareDrawRoots();
+        glm::mat4 getNodeMatrix(const tinygltf::Node& node, const glm::mat4& parentMatrix, bool isRoot) const;
+        // Appends the draws of node (and its children if recordChildren) to commands, skipping meshes outside the
+        // view frustum, touches no GL state so it can run on any thread
+        void recordNode(int nodeIdx, const glm::mat4& parentMatrix, bool isRoot, bool recordChildren, std::vector<DrawCommand>& commands) const;
+        // Streams the matrices of drawCommands to drawDataBuffer, then issues them, binding each material once per run of draws using it
+        void submitDrawCommands();
+        // Grows drawDataBuffer and drawIdVBO to hold at least drawCount draws
+        void reserveDrawData(size_t drawCount);
+        // Sets up the per instance draw id attribute on every model VAO, reading drawIdVBO
+        void attachDrawIds();
         void bindMaterial(const int materialIndex);
         void drawSkybox();
 
@@ -103,9 +221,17 @@ namespace renderer
         Camera camera;
         InputState inputState;
         gui::GUIHandler* guiHandler;
+        event::EventDispatcher eventDispatcher;
+        // When set, notify only queues events into deferredEvents, where repeated events of a type are merged
+        bool deferEvents = true;
+        event::EventCoalescer deferredEvents;
 
+        static const size_t POSTED_EVENTS_CAPACITY = 1024;
+        static constexpr float DEFERRED_EVENTS_BUDGET_MS = 2.0f;
+        static const int IDLE_WAIT_MS = 1000; // Upper bound, the main thread is woken up whenever it is needed
         std::string CUBEMAPS_PATH = "res/cubemaps"; // Must be in working directory
         std::string MODELS_PATH = "res/models"; // Must be in working directory
+        std::string GUI_LAYOUT_PATH = "res/gui/controls.json"; // Must be in working directory
         std::string targetCubemapFile = "Skybox1"; // Must be in CUBEMAPS_PATH, must match exact cubemap folder name
         std::string targetGLTFfile = "11_low_poly_us_navy_ddg-51_uss_arleigh_burke..glb"; // Must be in MODELS_PATH, must match exact file name, only .glb or .gltf (only embedded .gltf files allowed) files allowed
 
@@ -120,24 +246,67 @@ namespace renderer
         SDL_Window* window;
         SDL_GLContext context;
 
-        bool running = true;
+        std::thread renderThread;
+        FrameTimer frameTimer;
+        TripleBuffer<FrameSnapshot> snapshots;
+        std::mutex renderEventsMutex;
+        std::vector<SDL_Event> renderEvents; // Consumed by the render thread once per frame
+        EventQueue<event::EventRecord> postedEvents{ POSTED_EVENTS_CAPACITY };
+        // Published events read by replayStep, tagged with their recorded step so the render thread
+        // applies them once its snapshot has passed that step instead of whenever it drains them
+        struct ReplayedEvent
+        {
+            unsigned long long step;
+            event::EventRecord event;
+        };
+        std::mutex replayedEventsMutex;
+        std::deque<ReplayedEvent> replayedEvents;
+        std::mutex redrawMutex;
+        std::condition_variable redrawCondition;
+        bool redrawRequested = true; // The first frame is always drawn
+        std::mutex simulationTasksMutex;
+        std::vector<std::function<void()>> simulationTasks;
+
+        std::atomic<bool> running = true;
+        std::atomic<unsigned long long> simulationStep = 0; // Number of fixed updates run so far
+
+        RendererOptions options;
+        // Filled in for scripted runs (frameCount or reportPath set) and printed when the run ends
+        RunReport report;
+        bool reportEnabled = false;
+        CameraPath cameraRecording; // Main thread, only if options.cameraRecordPath is set
+        double cameraRecordingStart = 0.0; // getSeconds at the first keyframe of cameraRecording
+        CameraPath cameraPath; // Render thread, only if options.cameraPathFile is set
+        static const int CAMERA_KEYFRAMES_PER_SECOND = 4;
+        session::SessionRecorder* recorder = nullptr;
+        session::SessionReplayer* replayer = nullptr;
         float WINDOW_WIDTH;
         float WINDOW_HEIGHT;
         float NEAR_DIST; // Initialize using diagonal distance of the bounding box of the scene
         float FAR_DIST; // Initialize using diagonal distance of the bounding box of the scene
         const float FOV = (float)M_PI_2;
-        const int LOGIC_FREQ_HZ = 0; // Set to 0 for 60Hz, not for capping FPS
 
         /* 
             MODEL SPECIFIC SHADER RELATED VARIABLES
          */
-        GLint modelViewProjMatrixLoc, modelViewMatrixLoc, normalMatrixLoc, lightDirectionLoc, lightIntensityLoc,
+        GLint lightDirectionLoc, lightIntensityLoc,
             baseColorTextureLoc, baseColorFactorLoc, metallicRoughnessTextureLoc, metallicFactorLoc, roughnessFactorLoc,
             emissiveTextureLoc, emissiveFactorLoc, occlusionTextureLoc, occlusionStrengthLoc, applyOcclusionLoc;  
         GLuint shaderProgram, whiteTextureID = 0;
         std::vector<GLuint> modelTextureIDs, VAOs, VBOs;
         std::vector<utilgltf::VAOrange> meshToVertexArrays;
+        std::vector<utilgltf::MeshBounds> meshBounds;
+        std::vector<DrawRoot> drawRoots;
+        std::vector<std::vector<DrawCommand>> drawCommandLists; // One per DrawRoot, kept to reuse their capacity
+        std::vector<DrawCommand> drawCommands;
         glm::mat4 projMatrix, viewMatrix;
+        GLuint frameConstantsUBO = 0; // Bound at shaders::FRAME_CONSTANTS_BINDING
+        // Per draw matrices, written straight into mapped memory each frame and indexed by the draw id attribute.
+        // drawIdVBO holds 0..drawDataCapacity-1, each draw picks its entry with its base instance
+        StreamBuffer drawDataBuffer;
+        GLuint drawIdVBO = 0;
+        size_t drawDataCapacity = 0;
+        static const size_t INITIAL_DRAW_DATA_CAPACITY = 1024;
         // The diagonal distance of the bounding box produced by the model
         float sceneDiagonalDistance;
         float scaleFactor = 1.0f, luminanceFactor = 5.0f;
@@ -148,7 +317,6 @@ namespace renderer
         /* 
             SKYBOX SPECIFIC SHADER RELATED VARIABLES
          */
-        GLint viewSkyboxLoc, projectionSkyboxLoc;
         GLuint shaderProgramSkybox, skyboxVAO, skyboxVBO, skyboxEBO;
     };
 };
\ No newline at end of file
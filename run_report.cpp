@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#if defined(_WIN32)
+    #define NOMINMAX
+    #include <windows.h>
+    #include <psapi.h>
+#elif defined(__linux__)
+    #include <unistd.h>
+#endif
+
+#include "json.h"
+#include "run_report.h"
+
+size_t getResidentMemoryBytes()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return counters.WorkingSetSize;
+    }
+    return 0;
+#elif defined(__linux__)
+    std::ifstream statm("/proc/self/statm");
+    size_t totalPages = 0, residentPages = 0;
+    statm >> totalPages >> residentPages;
+    return residentPages * (size_t)sysconf(_SC_PAGESIZE);
+#else
+    return 0;
+#endif
+}
+
+size_t getPeakResidentMemoryBytes()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#elif defined(__linux__)
+    // The high water mark, given in kB
+    std::ifstream status("/proc/self/status");
+    std::string key;
+    while (status >> key)
+    {
+        if (key == "VmHWM:")
+        {
+            size_t kilobytes = 0;
+            status >> kilobytes;
+            return kilobytes * 1024;
+        }
+    }
+    return 0;
+#else
+    return 0;
+#endif
+}
+
+void RunReport::addLoadTime(const std::string& stage, double ms)
+{
+    loadTimes.emplace_back(stage, ms);
+}
+
+void RunReport::addFrame(float frameMs, float workMs, size_t drawCount)
+{
+    frameTimes.emplace_back(frameMs);
+    workTimes.emplace_back(workMs);
+    totalDraws += drawCount;
+}
+
+void RunReport::sampleMemory(const std::string& label)
+{
+    memorySamples.emplace_back(label, getResidentMemoryBytes());
+}
+
+void RunReport::print(std::ostream& out) const
+{
+    out << std::fixed << std::setprecision(2);
+    out << "Run summary" << std::endl;
+    for (const auto& loadTime : loadTimes)
+    {
+        out << "  load " << loadTime.first << ": " << loadTime.second << " ms" << std::endl;
+    }
+
+    Summary frame = summarize(frameTimes);
+    Summary work = summarize(workTimes);
+    out << "  frames: " << frameTimes.size() << std::endl;
+    out << "  frame ms: mean " << frame.mean << ", p50 " << frame.p50 << ", p99 " << frame.p99 << ", max " << frame.max << std::endl;
+    out << "  work ms:  mean " << work.mean << ", p50 " << work.p50 << ", p99 " << work.p99 << ", max " << work.max << std::endl;
+    if (!frameTimes.empty())
+    {
+        out << "  draws per frame: " << (double)totalDraws / frameTimes.size() << std::endl;
+    }
+
+    for (const auto& sample : memorySamples)
+    {
+        out << "  memory " << sample.first << ": " << sample.second / (1024.0 * 1024.0) << " MB" << std::endl;
+    }
+    out << "  memory peak: " << getPeakResidentMemoryBytes() / (1024.0 * 1024.0) << " MB" << std::endl;
+    out << std::defaultfloat;
+}
+
+bool RunReport::write(const std::string& path, const std::string& model, const std::string& cubemap) const
+{
+    nlohmann::json results;
+    results["model"] = model;
+    results["cubemap"] = cubemap;
+
+    nlohmann::json loads = nlohmann::json::object();
+    for (const auto& loadTime : loadTimes)
+    {
+        loads[loadTime.first] = loadTime.second;
+    }
+    results["load_ms"] = loads;
+
+    auto toJson = [](const Summary& summary)
+    {
+        return nlohmann::json{ {"mean_ms", summary.mean}, {"p50_ms", summary.p50}, {"p99_ms", summary.p99}, {"max_ms", summary.max} };
+    };
+    results["frames"] = frameTimes.size();
+    results["frame"] = toJson(summarize(frameTimes));
+    results["work"] = toJson(summarize(workTimes));
+    results["draws_per_frame"] = frameTimes.empty() ? 0.0 : (double)totalDraws / frameTimes.size();
+
+    nlohmann::json memory = nlohmann::json::object();
+    for (const auto& sample : memorySamples)
+    {
+        memory[sample.first] = sample.second;
+    }
+    memory["peak"] = getPeakResidentMemoryBytes();
+    results["memory_bytes"] = memory;
+
+    std::ofstream outFile(path);
+    if (!outFile)
+    {
+        std::cerr << "Failed to open " << path << " for writing" << std::endl;
+        return false;
+    }
+    outFile << results.dump(4) << std::endl;
+    std::cout << "Run report written to " << path << std::endl;
+    return true;
+}
+
+RunReport::Summary RunReport::summarize(std::vector<float> values)
+{
+    Summary summary;
+    if (values.empty())
+    {
+        return summary;
+    }
+
+    std::sort(values.begin(), values.end());
+    double total = 0.0;
+    for (float value : values)
+    {
+        total += value;
+    }
+
+    summary.mean = total / values.size();
+    summary.p50 = values[values.size() / 2];
+    summary.p99 = values[std::min(values.size() - 1, values.size() * 99 / 100)];
+    summary.max = values.back();
+    return summary;
+}
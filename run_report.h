@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <ostream>
+
+// Resident memory of the process right now and at its peak, 0 where the platform is not supported
+size_t getResidentMemoryBytes();
+size_t getPeakResidentMemoryBytes();
+
+// Summary of a scripted run (load times, frame times, memory), printed and optionally written
+// as JSON when the run ends so runs over different assets or builds can be compared
+class RunReport
+{
+public:
+    void addLoadTime(const std::string& stage, double ms);
+    // Called by the render thread once per presented frame
+    void addFrame(float frameMs, float workMs, size_t drawCount);
+    // Remembers the current memory use under label
+    void sampleMemory(const std::string& label);
+
+    void print(std::ostream& out) const;
+    // Returns false if path could not be written
+    bool write(const std::string& path, const std::string& model, const std::string& cubemap) const;
+
+private:
+    struct Summary
+    {
+        double mean = 0.0, p50 = 0.0, p99 = 0.0, max = 0.0;
+    };
+    static Summary summarize(std::vector<float> values);
+
+    std::vector<std::pair<std::string, double>> loadTimes;
+    std::vector<std::pair<std::string, size_t>> memorySamples;
+    std::vector<float> frameTimes;
+    std::vector<float> workTimes;
+    unsigned long long totalDraws = 0;
+};
@@ -0,0 +1,266 @@
+#include <iostream>
+#include <cstring>
+
+#include "session_log.h"
+
+namespace session
+{
+    namespace
+    {
+        const char MAGIC[4] = { 'P', 'G', 'S', 'L' };
+        const uint32_t VERSION = 1;
+
+        template<typename T>
+        void writeValue(std::ofstream& file, const T& value)
+        {
+            file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        template<typename T>
+        bool readValue(std::ifstream& file, T& value)
+        {
+            return (bool)file.read(reinterpret_cast<char*>(&value), sizeof(T));
+        }
+
+        void writeVec3(std::ofstream& file, const glm::vec3& v)
+        {
+            writeValue(file, v.x);
+            writeValue(file, v.y);
+            writeValue(file, v.z);
+        }
+
+        bool readVec3(std::ifstream& file, glm::vec3& v)
+        {
+            return readValue(file, v.x) && readValue(file, v.y) && readValue(file, v.z);
+        }
+
+        // Events with pointers into SDL owned memory can not be written out
+        bool isRecordable(const SDL_Event& sdlEvent)
+        {
+            return sdlEvent.type != SDL_DROPFILE && sdlEvent.type != SDL_DROPTEXT
+                && sdlEvent.type != SDL_SYSWMEVENT && sdlEvent.type < SDL_USEREVENT;
+        }
+
+        // Published events are written as their type followed by their single parameter, if any
+        bool readEvent(std::ifstream& file, event::EventRecord& record)
+        {
+            uint8_t type;
+            if (!readValue(file, type))
+            {
+                return false;
+            }
+
+            float value;
+            switch ((event::EventType)type)
+            {
+            case event::EventType::WindowResize:
+            {
+                int32_t newWidth, newHeight;
+                if (!readValue(file, newWidth) || !readValue(file, newHeight))
+                {
+                    return false;
+                }
+                record = event::WindowResizeEvent(newWidth, newHeight);
+                return true;
+            }
+            case event::EventType::Quit:        record = event::QuitEvent(); return true;
+            case event::EventType::NextModel:   record = event::NextModelEvent(); return true;
+            case event::EventType::NextCubemap: record = event::NextCubemapEvent(); return true;
+            case event::EventType::LightAzimuthChange:
+                if (!readValue(file, value)) return false;
+                record = event::LightAzimuthChangeEvent(value);
+                return true;
+            case event::EventType::LightInclineChange:
+                if (!readValue(file, value)) return false;
+                record = event::LightInclineChangeEvent(value);
+                return true;
+            case event::EventType::LuminanceChange:
+                if (!readValue(file, value)) return false;
+                record = event::LuminanceChangeEvent(value);
+                return true;
+            case event::EventType::ScaleChange:
+                if (!readValue(file, value)) return false;
+                record = event::ScaleChangeEvent(value);
+                return true;
+            case event::EventType::CameraSpeedChange:
+                if (!readValue(file, value)) return false;
+                record = event::CameraSpeedChangeEvent(value);
+                return true;
+            default:
+                return false;
+            }
+        }
+    }
+
+    SessionRecorder::~SessionRecorder()
+    {
+        if (file.is_open())
+        {
+            std::cout << "Recorded " << recordCount << " session records" << std::endl;
+        }
+    }
+
+    bool SessionRecorder::open(const std::filesystem::path& logPath)
+    {
+        file.open(logPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+        {
+            std::cerr << "Failed to create session log " << logPath << std::endl;
+            return false;
+        }
+
+        file.write(MAGIC, sizeof(MAGIC));
+        writeValue(file, VERSION);
+        writeValue(file, (uint32_t)sizeof(SDL_Event)); // SDL events are stored raw, so only replayable with the same layout
+        return true;
+    }
+
+    void SessionRecorder::recordSDLEvent(uint64_t step, const SDL_Event& sdlEvent)
+    {
+        if (!isRecordable(sdlEvent))
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        writeRecordHeader(RecordKind::SDLEvent, step);
+        writeValue(file, sdlEvent);
+    }
+
+    void SessionRecorder::recordTick(uint64_t step, const CameraState& camera)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        writeRecordHeader(RecordKind::Tick, step);
+        writeVec3(file, camera.cameraPos);
+        writeVec3(file, camera.targetPos);
+        writeVec3(file, camera.cameraUp);
+        writeValue(file, camera.cameraYaw);
+        writeValue(file, camera.cameraPitch);
+    }
+
+    void SessionRecorder::recordEvent(uint64_t step, const event::Event& event)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        writeRecordHeader(RecordKind::PublishedEvent, step);
+        writeValue(file, (uint8_t)event.getType());
+
+        if (const event::WindowResizeEvent* e = event::eventCast<event::WindowResizeEvent>(&event))
+        {
+            writeValue(file, (int32_t)e->newWidth);
+            writeValue(file, (int32_t)e->newHeight);
+        }
+        else if (const event::LightAzimuthChangeEvent* e = event::eventCast<event::LightAzimuthChangeEvent>(&event))
+        {
+            writeValue(file, e->delta);
+        }
+        else if (const event::LightInclineChangeEvent* e = event::eventCast<event::LightInclineChangeEvent>(&event))
+        {
+            writeValue(file, e->delta);
+        }
+        else if (const event::LuminanceChangeEvent* e = event::eventCast<event::LuminanceChangeEvent>(&event))
+        {
+            writeValue(file, e->delta);
+        }
+        else if (const event::ScaleChangeEvent* e = event::eventCast<event::ScaleChangeEvent>(&event))
+        {
+            writeValue(file, e->delta);
+        }
+        else if (const event::CameraSpeedChangeEvent* e = event::eventCast<event::CameraSpeedChangeEvent>(&event))
+        {
+            writeValue(file, e->factor);
+        }
+    }
+
+    uint64_t SessionRecorder::getRecordCount() const
+    {
+        return recordCount;
+    }
+
+    void SessionRecorder::writeRecordHeader(RecordKind kind, uint64_t step)
+    {
+        writeValue(file, (uint8_t)kind);
+        writeValue(file, step);
+        ++recordCount;
+    }
+
+    bool SessionReplayer::open(const std::filesystem::path& logPath)
+    {
+        std::ifstream file(logPath, std::ios::binary);
+        if (!file.is_open())
+        {
+            std::cerr << "Failed to open session log " << logPath << std::endl;
+            return false;
+        }
+
+        char magic[4];
+        uint32_t version, sdlEventSize;
+        if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0
+            || !readValue(file, version) || !readValue(file, sdlEventSize))
+        {
+            std::cerr << "File " << logPath << " is not a session log" << std::endl;
+            return false;
+        }
+        if (version != VERSION || sdlEventSize != sizeof(SDL_Event))
+        {
+            std::cerr << "Session log " << logPath << " was written by an incompatible build" << std::endl;
+            return false;
+        }
+
+        records.clear();
+        position = 0;
+
+        uint8_t kind;
+        while (readValue(file, kind))
+        {
+            SessionRecord record = {};
+            record.kind = (RecordKind)kind;
+
+            bool complete = readValue(file, record.step);
+            switch (record.kind)
+            {
+            case RecordKind::SDLEvent:
+                complete = complete && readValue(file, record.sdlEvent);
+                break;
+            case RecordKind::Tick:
+                complete = complete && readVec3(file, record.camera.cameraPos) && readVec3(file, record.camera.targetPos)
+                    && readVec3(file, record.camera.cameraUp) && readValue(file, record.camera.cameraYaw) && readValue(file, record.camera.cameraPitch);
+                break;
+            case RecordKind::PublishedEvent:
+                complete = complete && readEvent(file, record.event);
+                break;
+            default:
+                complete = false;
+                break;
+            }
+
+            if (!complete)
+            {
+                // Most likely the recording was cut short, everything before is still usable
+                std::cerr << "Session log " << logPath << " ends with an incomplete record, replaying the " << records.size() << " records before it" << std::endl;
+                break;
+            }
+            records.emplace_back(record);
+        }
+
+        return true;
+    }
+
+    const SessionRecord* SessionReplayer::next()
+    {
+        if (position >= records.size())
+        {
+            return nullptr;
+        }
+        return &records[position++];
+    }
+
+    bool SessionReplayer::isFinished() const
+    {
+        return position >= records.size();
+    }
+
+    size_t SessionReplayer::getRecordCount() const
+    {
+        return records.size();
+    }
+}
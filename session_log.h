@@ -0,0 +1,88 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <glm/glm.hpp>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+
+#include "event.h"
+
+// Binary log of a session for reproducing performance captures, a header followed by records, each
+// tagged with the number of fixed simulation steps run before it happened:
+// - SDL events as handled on the main thread, after motion coalescing
+// - a tick per fixed step with the camera state it produced
+// - events published to the renderer (e.g. by GUI buttons)
+// Replaying sets the camera from the ticks and applies the published events before the first frame drawing
+// the step after theirs, so what is drawn at each step matches the recording. The SDL events only drive the
+// GUI's own state, they reach it on the next frame like live input
+namespace session
+{
+    enum class RecordKind : uint8_t
+    {
+        SDLEvent,
+        Tick,
+        PublishedEvent
+    };
+
+    struct CameraState
+    {
+        glm::vec3 cameraPos;
+        glm::vec3 targetPos;
+        glm::vec3 cameraUp;
+        float cameraYaw;
+        float cameraPitch;
+    };
+
+    struct SessionRecord
+    {
+        RecordKind kind;
+        uint64_t step;
+        SDL_Event sdlEvent;          // SDLEvent
+        CameraState camera;          // Tick
+        event::EventRecord event;    // PublishedEvent
+    };
+
+    class SessionRecorder
+    {
+    public:
+        ~SessionRecorder();
+
+        // Creates or truncates the log at logPath and writes the header
+        bool open(const std::filesystem::path& logPath);
+
+        // All record functions can be called from any thread
+        // SDL events holding pointers (e.g. dropped files) are skipped
+        void recordSDLEvent(uint64_t step, const SDL_Event& sdlEvent);
+        void recordTick(uint64_t step, const CameraState& camera);
+        void recordEvent(uint64_t step, const event::Event& event);
+
+        uint64_t getRecordCount() const;
+
+    private:
+        void writeRecordHeader(RecordKind kind, uint64_t step);
+
+        std::mutex mutex;
+        std::ofstream file;
+        uint64_t recordCount = 0;
+    };
+
+    class SessionReplayer
+    {
+    public:
+        // Reads the whole log, returns false if it could not be read or was written by an incompatible build
+        bool open(const std::filesystem::path& logPath);
+
+        // Returns the next record, or nullptr once all records have been returned
+        const SessionRecord* next();
+        bool isFinished() const;
+
+        size_t getRecordCount() const;
+
+    private:
+        std::vector<SessionRecord> records;
+        size_t position = 0;
+    };
+}
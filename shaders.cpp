@@ -1,14 +1,41 @@
 #include "shaders.h"
 
 #include <iostream>
+#include <cstring>
 
 namespace shaders
 {
+    // The FrameConstants block, declared once here and added to every vertex shader by compileShader
+    const GLchar* frameConstantsSource = R"glsl(
+        layout (std140) uniform FrameConstants // See shaders::FrameConstants
+        {
+            mat4 view;
+            mat4 projection;
+            mat4 ortho;
+            vec4 viewport;
+            float time;
+        };
+    )glsl";
+
     // Function to compile a shader, helper method to createShaderProgram
     GLuint compileShader(const GLenum type, const GLchar *source)
     {
         GLuint shader = glCreateShader(type);
-        glShaderSource(shader, 1, &source, nullptr);
+        if (type == GL_VERTEX_SHADER)
+        {
+            // Right after the #version line, which has to come first
+            const GLchar* versionLine = std::strstr(source, "#version");
+            const GLchar* body = versionLine != nullptr ? std::strchr(versionLine, '\n') : nullptr;
+            body = body != nullptr ? body + 1 : source;
+
+            const GLchar* sources[] = { source, frameConstantsSource, body };
+            const GLint lengths[] = { GLint(body - source), -1, -1 };
+            glShaderSource(shader, 3, sources, lengths);
+        }
+        else
+        {
+            glShaderSource(shader, 1, &source, nullptr);
+        }
         glCompileShader(shader);
 
         GLint status;
@@ -51,33 +78,69 @@ namespace shaders
         glDeleteShader(vertexShader);
         glDeleteShader(fragmentShader);
 
+        // Programs not using the block simply don't have it
+        GLuint frameConstantsIndex = glGetUniformBlockIndex(program, "FrameConstants");
+        if (frameConstantsIndex != GL_INVALID_INDEX)
+        {
+            glUniformBlockBinding(program, frameConstantsIndex, FRAME_CONSTANTS_BINDING);
+        }
+
         return program;
     }
 
+    GLuint createFrameConstantsBuffer()
+    {
+        GLuint buffer;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameConstants), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_CONSTANTS_BINDING, buffer);
+
+        return buffer;
+    }
+
+    void updateFrameConstants(GLuint buffer, const FrameConstants& frameConstants)
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameConstants), &frameConstants);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
     /* 
         RENDERER/MODEL SHADERS
     */
     const GLchar* rendererVertexShaderSource = R"glsl(
-        #version 330
+        #version 430
 
         layout(location = 0) in vec3 aPosition;
         layout(location = 1) in vec3 aNormal;
         layout(location = 2) in vec2 aTexCoords;
+        layout(location = 3) in uint aDrawId; // Per instance, the base instance of the draw selects the entry
 
         out vec3 vViewSpacePosition;
         out vec3 vViewSpaceNormal;
         out vec2 vTexCoords;
 
-        uniform mat4 uModelViewProjMatrix;
-        uniform mat4 uModelViewMatrix;
-        uniform mat4 uNormalMatrix;
+        struct DrawData // See shaders::DrawData
+        {
+            mat4 modelView;
+            mat4 normal;
+        };
+
+        layout (std430, binding = 0) readonly buffer DrawDataBuffer // shaders::DRAW_DATA_BINDING
+        {
+            DrawData draws[];
+        };
 
         void main()
         {
-            vViewSpacePosition = vec3(uModelViewMatrix * vec4(aPosition, 1));
-            vViewSpaceNormal = normalize(vec3(uNormalMatrix * vec4(aNormal, 0)));
+            DrawData draw = draws[aDrawId];
+            vViewSpacePosition = vec3(draw.modelView * vec4(aPosition, 1));
+            vViewSpaceNormal = normalize(vec3(draw.normal * vec4(aNormal, 0)));
             vTexCoords = aTexCoords;
-            gl_Position =  uModelViewProjMatrix * vec4(aPosition, 1);
+            gl_Position = projection * vec4(vViewSpacePosition, 1);
         }
     )glsl";
     const GLchar* rendererFragmentShaderSource = R"glsl(
@@ -218,12 +281,10 @@ namespace shaders
 
         out vec3 texCoords;
 
-        uniform mat4 projection;
-        uniform mat4 view;
-
         void main()
         {
-            vec4 pos = projection * view * vec4(aPos, 1.0f);
+            // Only the rotation of the view, the skybox is always centered on the camera
+            vec4 pos = projection * mat4(mat3(view)) * vec4(aPos, 1.0f);
             // Having z equal w will always result in a depth of 1.0f
             gl_Position = vec4(pos.x, pos.y, pos.w, pos.w);
             // We want to flip the z axis due to the different coordinate systems (left hand vs right hand)
@@ -252,13 +313,12 @@ namespace shaders
         layout (location = 0) in vec3 aPos;
 
         uniform mat4 model;
-        uniform mat4 projection;
 
         out vec2 vPos;
 
         void main()
         {
-            gl_Position = projection * model * vec4(aPos, 1.0);
+            gl_Position = ortho * model * vec4(aPos, 1.0);
             vPos = aPos.xy;
         }
     )glsl";
@@ -302,29 +362,51 @@ namespace shaders
         }
     )glsl";
 
+    const GLchar* guiCompositeVertexShaderSource = R"glsl(
+        #version 330 core
+
+        // Fullscreen triangle generated from gl_VertexID, no vertex buffer needed
+        void main()
+        {
+            vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+            gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);
+        }
+    )glsl";
+    const GLchar* guiCompositeFragmentShaderSource = R"glsl(
+        #version 330 core
+        out vec4 FragColor;
+
+        uniform sampler2D guiTexture; // Cached GUI with premultiplied alpha, same size as the window
+
+        void main()
+        {
+            FragColor = texelFetch(guiTexture, ivec2(gl_FragCoord.xy), 0);
+        }
+    )glsl";
+
     /* 
         GUI TEXT SHADERS
     */
     const GLchar* textVertexShaderSource = R"glsl(
         #version 330 core
         layout (location = 0) in vec4 vertex; // <vec2 pos, vec2 tex>
-        out vec2 TexCoords;
+        layout (location = 1) in float layer; // Atlas layer in the font texture array
+        out vec3 TexCoords;
 
-        uniform mat4 projection;
         uniform mat4 model;
 
         void main()
         {
-            gl_Position = projection * model * vec4(vertex.xy, 0.0, 1.0);
-            TexCoords = vertex.zw;
+            gl_Position = ortho * model * vec4(vertex.xy, 0.0, 1.0);
+            TexCoords = vec3(vertex.zw, layer);
         }
     )glsl";
     const GLchar* textFragmentShaderSource = R"glsl(
         #version 330 core
-        in vec2 TexCoords;
+        in vec3 TexCoords;
         out vec4 color;
 
-        uniform sampler2D text;
+        uniform sampler2DArray text;
         uniform vec4 textColor;
         
         const float smoothing = 1.0f;
@@ -1,18 +1,51 @@
 #pragma once
 
 #include <glad/glad.h>
+#include <glm/glm.hpp>
 
 namespace shaders
 {
+    // Uniform buffer binding point of the FrameConstants block, set for every program by createShaderProgram
+    const GLuint FRAME_CONSTANTS_BINDING = 0;
+    // Shader storage buffer binding point of the DrawData array read by the model shader
+    const GLuint DRAW_DATA_BINDING = 0;
+    // Per instance attribute holding the index into DrawData, see Renderer::attachDrawIds
+    const GLuint VERTEX_ATTRIB_DRAW_ID_IDX = 3;
+
+    // Values shared by all passes during a frame, matches the std140 layout of the FrameConstants block in
+    // shaders.cpp, which compileShader adds to every vertex shader
+    struct FrameConstants
+    {
+        glm::mat4 view;
+        glm::mat4 projection;
+        glm::mat4 ortho; // Window space with the origin in the bottom left, used by the GUI
+        glm::vec4 viewport; // x, y, width, height
+        float time; // In seconds
+        float padding[3];
+    };
+
+    // Per draw values of the model shader, matches the std430 layout of its DrawData array
+    struct DrawData
+    {
+        glm::mat4 modelView;
+        glm::mat4 normal;
+    };
+
     GLuint compileShader(const GLenum type, const GLchar* source);
     GLuint createShaderProgram(const GLchar* vertexShaderSource, const GLchar* fragmentShaderSource);
 
+    // Creates the uniform buffer for FrameConstants and binds it to FRAME_CONSTANTS_BINDING
+    GLuint createFrameConstantsBuffer();
+    void updateFrameConstants(GLuint buffer, const FrameConstants& frameConstants);
+
     extern const GLchar* rendererVertexShaderSource;
     extern const GLchar* rendererFragmentShaderSource;
     extern const GLchar* skyboxVertexShaderSource;
     extern const GLchar* skyboxFragmentShaderSource;
     extern const GLchar* guiVertexShaderSource;
     extern const GLchar* guiFragmentShaderSource;
+    extern const GLchar* guiCompositeVertexShaderSource;
+    extern const GLchar* guiCompositeFragmentShaderSource;
     extern const GLchar* textVertexShaderSource;
     extern const GLchar* textFragmentShaderSource;
 }
\ No newline at end of file
@@ -0,0 +1,117 @@
+#include <iostream>
+
+#include "stream_buffer.h"
+
+StreamBuffer::~StreamBuffer()
+{
+    destroy();
+}
+
+bool StreamBuffer::create(GLenum target, GLsizeiptr regionSize)
+{
+    destroy();
+
+    GLint alignment = 256;
+    if (target == GL_SHADER_STORAGE_BUFFER)
+    {
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    }
+    else if (target == GL_UNIFORM_BUFFER)
+    {
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    }
+    this->target = target;
+    this->regionSize = (regionSize + alignment - 1) / alignment * alignment;
+
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(target, buffer);
+    glBufferStorage(target, this->regionSize * FRAMES_IN_FLIGHT, nullptr, flags);
+    mapped = (unsigned char*)glMapBufferRange(target, 0, this->regionSize * FRAMES_IN_FLIGHT, flags);
+    glBindBuffer(target, 0);
+
+    if (mapped == nullptr)
+    {
+        std::cerr << "Failed to persistently map stream buffer of " << this->regionSize * FRAMES_IN_FLIGHT << " bytes" << std::endl;
+        destroy();
+        return false;
+    }
+
+    currentRegion = 0;
+    return true;
+}
+
+void StreamBuffer::destroy()
+{
+    if (buffer == 0)
+    {
+        return;
+    }
+
+    // The GPU may still be reading any of the regions
+    for (int region = 0; region < FRAMES_IN_FLIGHT; ++region)
+    {
+        waitForRegion(region);
+    }
+
+    if (mapped != nullptr)
+    {
+        glBindBuffer(target, buffer);
+        glUnmapBuffer(target);
+        glBindBuffer(target, 0);
+        mapped = nullptr;
+    }
+    glDeleteBuffers(1, &buffer);
+    buffer = 0;
+}
+
+void* StreamBuffer::beginFrame()
+{
+    currentRegion = (currentRegion + 1) % FRAMES_IN_FLIGHT;
+    waitForRegion(currentRegion);
+    return mapped + regionSize * currentRegion;
+}
+
+void StreamBuffer::endFrame()
+{
+    fences[currentRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void StreamBuffer::bindRegion(GLuint index) const
+{
+    glBindBufferRange(target, index, buffer, regionSize * currentRegion, regionSize);
+}
+
+GLsizeiptr StreamBuffer::getRegionSize() const
+{
+    return regionSize;
+}
+
+GLuint StreamBuffer::getBuffer() const
+{
+    return buffer;
+}
+
+void StreamBuffer::waitForRegion(int region)
+{
+    GLsync fence = fences[region];
+    if (fence == nullptr)
+    {
+        return;
+    }
+
+    // Normally signaled long ago, FRAMES_IN_FLIGHT frames have been submitted since
+    GLbitfield waitFlags = 0;
+    while (true)
+    {
+        GLenum result = glClientWaitSync(fence, waitFlags, 1000000); // 1 ms
+        if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED)
+        {
+            break;
+        }
+        waitFlags = GL_SYNC_FLUSH_COMMANDS_BIT; // Make sure the fence gets submitted if we have to wait
+    }
+
+    glDeleteSync(fence);
+    fences[region] = nullptr;
+}
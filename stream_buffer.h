@@ -0,0 +1,44 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <array>
+
+// Buffer for data written by the CPU every frame and read by the GPU in the same frame, created once with
+// glBufferStorage and kept mapped (persistent, coherent) so writing is a plain memcpy without any driver calls.
+// It is split into FRAMES_IN_FLIGHT regions used in turn, before a region is reused beginFrame waits on the fence
+// placed after the GPU's last use of it, instead of the driver stalling implicitly on a glBufferSubData
+class StreamBuffer
+{
+public:
+    static const int FRAMES_IN_FLIGHT = 3;
+
+    StreamBuffer() = default;
+    ~StreamBuffer();
+
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+    // regionSize is rounded up to the offset alignment of target, returns false if the buffer could not be mapped
+    bool create(GLenum target, GLsizeiptr regionSize);
+    void destroy();
+
+    // Waits until the GPU is done with the next region and returns a pointer to it, regionSize bytes long
+    void* beginFrame();
+    // Fences the current region, call after the last draw reading it
+    void endFrame();
+    // Binds the current region to index of the buffer's target
+    void bindRegion(GLuint index) const;
+
+    GLsizeiptr getRegionSize() const;
+    GLuint getBuffer() const;
+
+private:
+    void waitForRegion(int region);
+
+    GLenum target = 0;
+    GLuint buffer = 0;
+    GLsizeiptr regionSize = 0;
+    unsigned char* mapped = nullptr;
+    std::array<GLsync, FRAMES_IN_FLIGHT> fences = {};
+    int currentRegion = 0;
+};
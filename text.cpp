@@ -2,16 +2,24 @@
 #include <fstream>
 #include <sstream>
 #include <map>
+#include <algorithm>
 
 #include "json.h"
 #include "text.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TEXT_SIMD_SSE 1
+#else
+#define TEXT_SIMD_SSE 0
+#endif
+
 namespace text
 {
     // TODO: Texts created with this (actually, everywhere) aren't being registered to Font's characters (?)
-    std::vector<Character*> createText(std::wstring text, Font* font)
+    void createText(const std::wstring& text, Font* font, std::vector<Character*>& characters)
     {
-        std::vector<Character*> characters;
+        characters.clear();
         for (const auto& wc : text)
         {
             bool charFound = false;
@@ -23,35 +31,49 @@ namespace text
 
             characters.emplace_back(character);
         }
-
-        return characters;
     }
 
-    std::vector<Line*> createLines(std::vector<Character*> characters, float* totalWidth, float* totalHeight)
+    Span<Line> createLines(const std::vector<Character*>& characters, LayoutArena& arena, float* totalWidth, float* totalHeight)
     {
-        std::vector<text::Line*> lines;
-        lines.emplace_back(new text::Line());
+        // Count Lines and non new-line Characters first so that both arrays can be allocated exactly
+        size_t lineCount = 1, newLineCount = 0;
+        for (const auto ch : characters)
+        {
+            if (ch->id == '\n')
+            {
+                ++lineCount;
+                ++newLineCount;
+            }
+        }
+
+        Span<Line> lines;
+        lines.data = arena.allocate<Line>(lineCount);
+        lines.count = 1;
         if (characters.empty()) {
             return lines;
         }
 
+        Character** lineCharacters = arena.allocate<Character*>(characters.size() - newLineCount);
+        lines.back().characters.data = lineCharacters;
+
         float fontSize = characters[0]->font->getSize();
         float lineWidth = 0, lineHeight = 0, maxAscender = 0, yPos = 0;
         for (const auto ch : characters)
         {
             if (ch->id == '\n')
             {
-                lines.back()->height = lineHeight;
-                lines.back()->maxAscender = maxAscender; // Set maxAscender for the line
-                lines.back()->endX = lineWidth;
+                lines.back().height = lineHeight;
+                lines.back().maxAscender = maxAscender; // Set maxAscender for the line
+                lines.back().endX = lineWidth;
                 *totalWidth = std::max(*totalWidth, lineWidth); // Keep the maximum line width
                 *totalHeight += lineHeight;
 
                 yPos -= lineHeight; // Update the yPosition for the next line
 
-                lines.emplace_back(new text::Line());
-                lines.back()->startX = 0;
-                lines.back()->yPosition = yPos;
+                ++lines.count;
+                lines.back().startX = 0;
+                lines.back().yPosition = yPos;
+                lines.back().characters.data = lineCharacters;
 
                 lineWidth = 0;
                 lineHeight = 0;
@@ -59,7 +81,8 @@ namespace text
                 continue;
             }
 
-            lines.back()->characters.emplace_back(ch);
+            *lineCharacters++ = ch;
+            ++lines.back().characters.count;
             lineWidth += ch->advance * fontSize;
 
             // Different Characters can have different Fonts,
@@ -72,15 +95,185 @@ namespace text
         }
 
         // Update height, maxAscender, totalWidth, totalHeight, and endX for last line
-        lines.back()->height = lineHeight;
-        lines.back()->maxAscender = maxAscender;
-        lines.back()->endX = lineWidth;
+        lines.back().height = lineHeight;
+        lines.back().maxAscender = maxAscender;
+        lines.back().endX = lineWidth;
         *totalWidth = std::max(*totalWidth, lineWidth);
         *totalHeight += lineHeight;
 
         return lines;
     }
 
+    // Writes the 4 vertices of a single glyph quad, used for the glyphs left over by the SIMD path
+    static inline void writeGlyphQuad(const Glyph& glyph, float xCursor, float yCursor, float textScale, float* out)
+    {
+        float x1 = xCursor + glyph.left * textScale;
+        float y1 = yCursor + glyph.bottom * textScale;
+        float x2 = xCursor + glyph.right * textScale;
+        float y2 = yCursor + glyph.top * textScale;
+
+        out[0] = x1;  out[1] = y1;  out[2] = glyph.u1;  out[3] = glyph.v1;  out[4] = glyph.layer;
+        out[5] = x2;  out[6] = y1;  out[7] = glyph.u2;  out[8] = glyph.v1;  out[9] = glyph.layer;
+        out[10] = x1; out[11] = y2; out[12] = glyph.u1; out[13] = glyph.v2; out[14] = glyph.layer;
+        out[15] = x2; out[16] = y2; out[17] = glyph.u2; out[18] = glyph.v2; out[19] = glyph.layer;
+    }
+
+    float writeLineVertices(const Line& line, float xCursor, float yCursor, float textScale, float* out)
+    {
+        size_t count = line.characters.size();
+        size_t i = 0;
+
+#if TEXT_SIMD_SSE
+        // 4 glyphs at a time, each lane holds one glyph and the pen positions are a prefix sum of the advances
+        const __m128 scale = _mm_set1_ps(textScale);
+        const __m128 y = _mm_set1_ps(yCursor);
+        for (; i + 4 <= count; i += 4)
+        {
+            const Glyph& g0 = line.characters[i]->glyph;
+            const Glyph& g1 = line.characters[i + 1]->glyph;
+            const Glyph& g2 = line.characters[i + 2]->glyph;
+            const Glyph& g3 = line.characters[i + 3]->glyph;
+
+            __m128 advance = _mm_mul_ps(_mm_set_ps(g3.advance, g2.advance, g1.advance, g0.advance), scale);
+            __m128 advanceSum = _mm_add_ps(advance, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(advance), 4)));
+            advanceSum = _mm_add_ps(advanceSum, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(advanceSum), 8)));
+            __m128 x = _mm_add_ps(_mm_set1_ps(xCursor), _mm_sub_ps(advanceSum, advance));
+
+            __m128 x1 = _mm_add_ps(x, _mm_mul_ps(_mm_set_ps(g3.left, g2.left, g1.left, g0.left), scale));
+            __m128 y1 = _mm_add_ps(y, _mm_mul_ps(_mm_set_ps(g3.bottom, g2.bottom, g1.bottom, g0.bottom), scale));
+            __m128 x2 = _mm_add_ps(x, _mm_mul_ps(_mm_set_ps(g3.right, g2.right, g1.right, g0.right), scale));
+            __m128 y2 = _mm_add_ps(y, _mm_mul_ps(_mm_set_ps(g3.top, g2.top, g1.top, g0.top), scale));
+            __m128 u1 = _mm_set_ps(g3.u1, g2.u1, g1.u1, g0.u1);
+            __m128 v1 = _mm_set_ps(g3.v1, g2.v1, g1.v1, g0.v1);
+            __m128 u2 = _mm_set_ps(g3.u2, g2.u2, g1.u2, g0.u2);
+            __m128 v2 = _mm_set_ps(g3.v2, g2.v2, g1.v2, g0.v2);
+
+            // Transpose lanes into one <pos, tex> vec4 per glyph for each corner of the quads
+            __m128 bottomLeft[4] = { x1, y1, u1, v1 };
+            __m128 bottomRight[4] = { x2, y1, u2, v1 };
+            __m128 topLeft[4] = { x1, y2, u1, v2 };
+            __m128 topRight[4] = { x2, y2, u2, v2 };
+            _MM_TRANSPOSE4_PS(bottomLeft[0], bottomLeft[1], bottomLeft[2], bottomLeft[3]);
+            _MM_TRANSPOSE4_PS(bottomRight[0], bottomRight[1], bottomRight[2], bottomRight[3]);
+            _MM_TRANSPOSE4_PS(topLeft[0], topLeft[1], topLeft[2], topLeft[3]);
+            _MM_TRANSPOSE4_PS(topRight[0], topRight[1], topRight[2], topRight[3]);
+
+            // Written strictly in order so that write-combined mapped memory is filled sequentially
+            const float layers[4] = { g0.layer, g1.layer, g2.layer, g3.layer };
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                float* quad = out + (i + lane) * GLYPH_QUAD_FLOATS;
+                _mm_storeu_ps(quad, bottomLeft[lane]);
+                quad[4] = layers[lane];
+                _mm_storeu_ps(quad + 5, bottomRight[lane]);
+                quad[9] = layers[lane];
+                _mm_storeu_ps(quad + 10, topLeft[lane]);
+                quad[14] = layers[lane];
+                _mm_storeu_ps(quad + 15, topRight[lane]);
+                quad[19] = layers[lane];
+            }
+
+            xCursor += _mm_cvtss_f32(_mm_shuffle_ps(advanceSum, advanceSum, _MM_SHUFFLE(3, 3, 3, 3)));
+        }
+#endif
+
+        for (; i < count; ++i)
+        {
+            const Glyph& glyph = line.characters[i]->glyph;
+            writeGlyphQuad(glyph, xCursor, yCursor, textScale, out + i * GLYPH_QUAD_FLOATS);
+            xCursor += glyph.advance * textScale;
+        }
+
+        return xCursor;
+    }
+
+    void writeQuadIndices(size_t quadCount, unsigned int* out)
+    {
+        // Two counter-clockwise triangles, bottom-left, bottom-right, top-left and top-left, bottom-right, top-right
+        for (size_t i = 0; i < quadCount; ++i)
+        {
+            unsigned int first = (unsigned int)(i * 4);
+            out[0] = first;
+            out[1] = first + 1;
+            out[2] = first + 2;
+            out[3] = first + 2;
+            out[4] = first + 1;
+            out[5] = first + 3;
+            out += GLYPH_QUAD_INDICES;
+        }
+    }
+
+    std::atomic<size_t> LayoutArena::totalHeapAllocationCount{0};
+
+    LayoutArena::LayoutArena(size_t blockSize) : blockSize(blockSize) {}
+
+    LayoutArena::~LayoutArena()
+    {
+        for (auto& block : blocks)
+        {
+            ::operator delete(block.data);
+        }
+    }
+
+    void LayoutArena::reset()
+    {
+        // If the last layout spilled over into several blocks, replace them with one block
+        // large enough for all of it so the next layout of the same size fits without spilling
+        if (currentBlock > 0)
+        {
+            size_t totalSize = 0;
+            for (auto& block : blocks)
+            {
+                totalSize += block.size;
+                ::operator delete(block.data);
+            }
+            blocks.clear();
+            addBlock(totalSize);
+        }
+
+        currentBlock = 0;
+        offset = 0;
+    }
+
+    size_t LayoutArena::getHeapAllocationCount() const
+    {
+        return heapAllocationCount;
+    }
+
+    size_t LayoutArena::getTotalHeapAllocationCount()
+    {
+        return totalHeapAllocationCount.load(std::memory_order_relaxed);
+    }
+
+    void* LayoutArena::allocateBytes(size_t size, size_t alignment)
+    {
+        while (currentBlock < blocks.size())
+        {
+            Block& block = blocks[currentBlock];
+            size_t alignedOffset = (offset + alignment - 1) & ~(alignment - 1);
+            if (alignedOffset + size <= block.size)
+            {
+                offset = alignedOffset + size;
+                return block.data + alignedOffset;
+            }
+
+            // Move on to the next block, any remainder of this one stays unused until reset
+            ++currentBlock;
+            offset = 0;
+        }
+
+        addBlock(size + alignment);
+        return allocateBytes(size, alignment);
+    }
+
+    void LayoutArena::addBlock(size_t minSize)
+    {
+        size_t size = std::max(blockSize, minSize);
+        blocks.push_back({ static_cast<char*>(::operator new(size)), size });
+        ++heapAllocationCount;
+        ++totalHeapAllocationCount;
+    }
+
     // TODO: If the requested font folder exists but does not contain the files necessary to load the font, then this constructor
     // will return an incomplete Font which will cause issues elsewhere, in particular when calling createText using the Font
     Font::Font(std::string fontName, std::filesystem::path fontFolderPath)
@@ -113,6 +306,19 @@ namespace text
     void Font::registerCharacter(Character* character) 
     {
         characters.push_back(character);
+
+        // Font metrics are parsed before any Character is created, so the glyph can be filled in right away
+        Glyph& glyph = character->glyph;
+        glyph.left = character->planeLeft * size;
+        glyph.bottom = character->planeBottom * size;
+        glyph.right = character->planeRight * size;
+        glyph.top = character->planeTop * size;
+        glyph.u1 = character->atlasLeft / textureWidth;
+        glyph.v1 = character->atlasBottom / textureHeight;
+        glyph.u2 = character->atlasRight / textureWidth;
+        glyph.v2 = character->atlasTop / textureHeight;
+        glyph.advance = character->advance * size;
+        glyph.layer = (float)atlasLayer;
     }
 
     void Font::removeCharacter(Character* character) 
@@ -191,14 +397,29 @@ namespace text
         return descender;
     }
 
-    bool Font::loadFontPaths(std::filesystem::path fontFolderPath)
+    void Font::setAtlasLayer(int layer)
     {
-        std::filesystem::path searchPath(fontFolderPath);
-        std::cout << "Checking existence of: " << std::filesystem::absolute(searchPath) << std::endl;
+        atlasLayer = layer;
+
+        // Glyphs are always on the first atlas page of their Font
+        for (Character* character : characters)
+        {
+            character->glyph.layer = (float)layer;
+        }
+    }
+
+    int Font::getAtlasLayer()
+    {
+        return atlasLayer;
+    }
+
+    bool Font::prepareFontFolder(const std::filesystem::path& fontFolderPath)
+    {
+        std::cout << "Checking existence of: " << std::filesystem::absolute(fontFolderPath) << std::endl;
 
-        if (!std::filesystem::exists(searchPath))
+        if (!std::filesystem::exists(fontFolderPath))
         {
-            searchPath = std::filesystem::current_path().parent_path() / fontFolderPath;
+            std::filesystem::path searchPath = std::filesystem::current_path().parent_path() / fontFolderPath;
 
             if (std::filesystem::exists(searchPath))
             {
@@ -235,6 +456,18 @@ namespace text
             }
         }
 
+        return true;
+    }
+
+    bool Font::loadFontPaths(std::filesystem::path fontFolderPath)
+    {
+        if (!prepareFontFolder(fontFolderPath))
+        {
+            return false;
+        }
+        // Relative to the working directory prepareFontFolder may have changed
+        std::filesystem::path searchPath(fontFolderPath);
+
         try
         {
             for (const auto& entry : std::filesystem::directory_iterator(searchPath))
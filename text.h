@@ -2,15 +2,99 @@
 
 #include <filesystem>
 #include <unordered_map>
+#include <vector>
+#include <atomic>
+#include <new>
+#include <type_traits>
 
 namespace text
 {
     struct Character;
     struct Line;
     class Font;
+    class LayoutArena;
 
-    std::vector<Character*> createText(std::wstring text, Font* font);
-    std::vector<Line*> createLines(std::vector<Character*> characters, float* totalWidth, float* totalHeight);
+    // Non-owning view of an array, used for the arrays handed out by LayoutArena
+    template <typename T>
+    struct Span
+    {
+        T* data = nullptr;
+        size_t count = 0;
+
+        T* begin() const { return data; }
+        T* end() const { return data + count; }
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        T& operator[](size_t i) const { return data[i]; }
+        T& back() const { return data[count - 1]; }
+    };
+
+    // Fills characters with the Characters of text, reusing the capacity of characters
+    void createText(const std::wstring& text, Font* font, std::vector<Character*>& characters);
+    // Lines and their Character arrays are allocated in arena and live until the arena is reset
+    Span<Line> createLines(const std::vector<Character*>& characters, LayoutArena& arena, float* totalWidth, float* totalHeight);
+
+    // Glyph quads are 4 vertices of <vec2 pos, vec2 tex, float layer>, drawn with the indices from writeQuadIndices
+    const int GLYPH_VERTEX_FLOATS = 5;
+    const int GLYPH_QUAD_FLOATS = GLYPH_VERTEX_FLOATS * 4;
+    const int GLYPH_QUAD_INDICES = 6;
+
+    // Writes one quad per Character of line into out, which must have room for line.characters.size() * GLYPH_QUAD_FLOATS 
+    // floats, starting at the pen position (xCursor, yCursor), returns xCursor advanced past the last Character
+    float writeLineVertices(const Line& line, float xCursor, float yCursor, float textScale, float* out);
+    // Writes the GLYPH_QUAD_INDICES indices of quadCount consecutive quads into out
+    void writeQuadIndices(size_t quadCount, unsigned int* out);
+
+    // Bump allocator for text layout objects, owned by whoever lays out text and reset on every relayout,
+    // once its first block is large enough, relayouts do not touch the general-purpose heap at all
+    class LayoutArena
+    {
+    public:
+        LayoutArena(size_t blockSize = 4096);
+        ~LayoutArena();
+
+        LayoutArena(const LayoutArena&) = delete;
+        LayoutArena& operator=(const LayoutArena&) = delete;
+
+        // Destructors are never run for arena objects, so only trivially destructible types are allowed
+        template <typename T>
+        T* allocate(size_t count)
+        {
+            static_assert(std::is_trivially_destructible<T>::value, "LayoutArena objects are never destroyed");
+            T* objects = static_cast<T*>(allocateBytes(sizeof(T) * count, alignof(T)));
+            for (size_t i = 0; i < count; ++i)
+            {
+                new (&objects[i]) T();
+            }
+
+            return objects;
+        }
+
+        // Invalidates everything allocated so far
+        void reset();
+
+        // Number of heap allocations made by this arena, and by all arenas combined
+        size_t getHeapAllocationCount() const;
+        static size_t getTotalHeapAllocationCount();
+
+    private:
+        struct Block
+        {
+            char* data;
+            size_t size;
+        };
+
+        void* allocateBytes(size_t size, size_t alignment);
+        void addBlock(size_t minSize);
+
+        std::vector<Block> blocks;
+        size_t currentBlock = 0;
+        size_t offset = 0;
+        size_t blockSize;
+        size_t heapAllocationCount = 0;
+
+        static std::atomic<size_t> totalHeapAllocationCount;
+    };
 
     class Font
     {
@@ -23,6 +107,11 @@ namespace text
         Character* getCharacter(const wchar_t &wc, bool* result);
 
         static Font* getDefaultFont();
+        // Moves the working directory up one level if fontFolderPath is only found from there (e.g. when started from
+        // a build directory) and picks defaultFontPath next to it unless set, returns false if the folder is not found.
+        // Called by the constructor, which only reads both once it has succeeded, so call it for every
+        // folder before constructing Fonts on several threads
+        static bool prepareFontFolder(const std::filesystem::path& fontFolderPath);
         static std::filesystem::path defaultFontPath;
         static Font* defaultFont;
         
@@ -37,6 +126,10 @@ namespace text
         float getAscender();
         float getDescender();
 
+        // Layer of the first atlas page of the Font in its texture array, set by gui::GUIFontAtlas
+        void setAtlasLayer(int layer);
+        int getAtlasLayer();
+
     private:
         std::string fontName;
         std::filesystem::path fontFolderPath;
@@ -55,14 +148,25 @@ namespace text
         float descender;
         float underlineY;
         float underlineThickness;
+        int atlasLayer = -1; // -1 until the atlas pages have been loaded into a texture array
 
         bool loadFontPaths(std::filesystem::path fontFolderPath);
         bool bindCharacterIDs();
     };
 
+    // Character metrics in the units writeLineVertices uses, kept up to date by the Character's Font
+    struct Glyph
+    {
+        float left, bottom, right, top; // Plane bounds in pixels at a textScale of 1
+        float u1, v1, u2, v2; // Atlas bounds normalized to texture coordinates
+        float advance; // In pixels at a textScale of 1
+        float layer; // Atlas layer of the Font's texture array
+    };
+
     struct Character
     {
         Font* font;
+        Glyph glyph;
         unsigned int id;
         float advance;
         float planeLeft; // Plane variables are in EMs
@@ -99,13 +203,13 @@ namespace text
     };
 
     struct Line {
-        std::vector<text::Character*> characters;
+        Span<text::Character*> characters; // Allocated in the LayoutArena the Line was created in
         float startX;
         float endX;
         float yPosition; // yPosition reaches to top of Line, not bottom
         float height;
         float maxAscender;
 
-        Line() : startX(0), endX(0), yPosition(0), height(0) {}
+        Line() : startX(0), endX(0), yPosition(0), height(0), maxAscender(0) {}
     };
 }
\ No newline at end of file
@@ -40,6 +40,68 @@ namespace texturel
         return textureID;
     }
 
+    GLuint createTextureArray(int width, int height, int layerCount, int nbrChannels, GLuint sourceArrayID, int sourceLayerCount)
+    {
+        GLuint textureArrayID;
+        glGenTextures(1, &textureArrayID);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, textureArrayID);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        // Single mip level, the font atlases are only ever sampled with GL_LINEAR
+        GLenum internalFormat = (nbrChannels == 3) ? GL_RGB8 : GL_RGBA8;
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, internalFormat, width, height, layerCount);
+
+        if (sourceArrayID != 0 && sourceLayerCount > 0)
+        {
+            glCopyImageSubData(sourceArrayID, GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0,
+                textureArrayID, GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0,
+                width, height, sourceLayerCount);
+        }
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        return textureArrayID;
+    }
+
+    bool loadTextureArrayLayer(GLuint textureArrayID, int layer, int width, int height, const std::filesystem::path& texturePath, bool flipVertically, int nbrChannels)
+    {
+        stbi_set_flip_vertically_on_load(flipVertically); // Or the textures load upside down
+
+        int imageWidth, imageHeight;
+        std::cout << "Loading texture array layer " << layer << " from: " << texturePath.string().c_str() << std::endl;
+        unsigned char* texture = stbi_load(texturePath.string().c_str(), &imageWidth, &imageHeight, nullptr, nbrChannels);
+        stbi_set_flip_vertically_on_load(false);
+        if (texture == NULL)
+        {
+            std::cerr << "Failed to load texture at: " << texturePath.string().c_str() << std::endl;
+            return false;
+        }
+
+        if (imageWidth != width || imageHeight != height)
+        {
+            std::cerr << "Texture at: " << texturePath.string().c_str() << " does not match texture array size " << width << "x" << height << std::endl;
+            stbi_image_free(texture);
+            return false;
+        }
+
+        // Rows of RGB texels are not necessarily 4-byte aligned
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        GLenum format = (nbrChannels == 3) ? GL_RGB : GL_RGBA;
+        glBindTexture(GL_TEXTURE_2D_ARRAY, textureArrayID);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, width, height, 1, format, GL_UNSIGNED_BYTE, texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        stbi_image_free(texture);
+
+        return true;
+    }
+
     bool loadCubemapTextures(GLuint textureID, std::filesystem::path facesCubemap[6]) 
     {
         for (unsigned int i = 0; i < 6; i++)
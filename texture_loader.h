@@ -5,5 +5,10 @@
 namespace texturel
 {
     GLuint loadFontTexture(const std::filesystem::path& texturePath, bool flipVertically = true, int nbrChannels = 3);
+    // Creates a GL_TEXTURE_2D_ARRAY with immutable storage for layerCount layers of width x height texels,
+    // if sourceArrayID is non-zero its first sourceLayerCount layers are copied into the new array
+    GLuint createTextureArray(int width, int height, int layerCount, int nbrChannels = 3, GLuint sourceArrayID = 0, int sourceLayerCount = 0);
+    // Loads the image at texturePath into the given layer of a texture array, the image must match the array size
+    bool loadTextureArrayLayer(GLuint textureArrayID, int layer, int width, int height, const std::filesystem::path& texturePath, bool flipVertically = true, int nbrChannels = 3);
     bool loadCubemapTextures(GLuint textureID, std::filesystem::path facesCubemap[6]);
 }
\ No newline at end of file
@@ -4,9 +4,11 @@
 
 #include <iostream>
 #include <functional>
+#include <algorithm>
 #include <glm/gtc/type_ptr.hpp>
 
 #include "util_gltf.h"
+#include "jobs.h"
 
 namespace utilgltf
 {
@@ -260,6 +262,64 @@ namespace utilgltf
                                                         node.scale[1], node.scale[2]));
     }
 
+    namespace
+    {
+        // The positions of one primitive placed in the world, read through its index buffer if it has one
+        struct BoundsSource
+        {
+            glm::mat4 modelMatrix;
+            const unsigned char* positions;
+            size_t positionByteStride;
+            const unsigned char* indices; // nullptr if not indexed
+            size_t indexByteStride;
+            int indexComponentType;
+            size_t count; // Number of indices, or positions if not indexed
+        };
+
+        // A range of a BoundsSource handled by one job
+        struct BoundsChunk
+        {
+            size_t sourceIdx;
+            size_t begin;
+            size_t end;
+            glm::vec3 bboxMin;
+            glm::vec3 bboxMax;
+        };
+
+        const size_t BOUNDS_CHUNK_SIZE = 16384; // Vertices per job
+
+        void computeChunkBounds(const BoundsSource& source, BoundsChunk& chunk)
+        {
+            chunk.bboxMin = glm::vec3(std::numeric_limits<float>::max());
+            chunk.bboxMax = glm::vec3(std::numeric_limits<float>::lowest());
+            for (size_t i = chunk.begin; i < chunk.end; ++i)
+            {
+                size_t index = i;
+                if (source.indices != nullptr)
+                {
+                    const unsigned char* indexData = source.indices + source.indexByteStride * i;
+                    switch (source.indexComponentType)
+                    {
+                    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+                        index = *((const uint8_t *)indexData);
+                        break;
+                    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+                        index = *((const uint16_t *)indexData);
+                        break;
+                    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+                        index = *((const uint32_t *)indexData);
+                        break;
+                    }
+                }
+
+                const auto &localPosition = *((const glm::vec3 *)(source.positions + source.positionByteStride * index));
+                const auto worldPosition = glm::vec3(source.modelMatrix * glm::vec4(localPosition, 1.f));
+                chunk.bboxMin = glm::min(chunk.bboxMin, worldPosition);
+                chunk.bboxMax = glm::max(chunk.bboxMax, worldPosition);
+            }
+        }
+    }
+
     void computeSceneBounds(const tinygltf::Model &model, glm::vec3 &bboxMin, glm::vec3 &bboxMax)
     {
         // Compute scene bounding box
@@ -267,114 +327,158 @@ namespace utilgltf
         // todo need a visitScene generic function that takes a accept() functor
         bboxMin = glm::vec3(std::numeric_limits<float>::max());
         bboxMax = glm::vec3(std::numeric_limits<float>::lowest());
-        if (model.defaultScene >= 0) 
+        if (model.defaultScene < 0) 
         {
-            const std::function<void(int, const glm::mat4 &)> updateBounds = [&](int nodeIdx, const glm::mat4 &parentMatrix) 
+            return;
+        }
+
+        // The node hierarchy is walked on this thread to place each primitive, the vertices are then transformed in parallel
+        std::vector<BoundsSource> sources;
+        const std::function<void(int, const glm::mat4 &)> collectSources = [&](int nodeIdx, const glm::mat4 &parentMatrix) 
+        {
+            const auto &node = model.nodes[nodeIdx];
+            const glm::mat4 modelMatrix = getLocalToWorldMatrix(node, parentMatrix);
+            if (node.mesh >= 0) 
             {
-                const auto &node = model.nodes[nodeIdx];
-                const glm::mat4 modelMatrix = getLocalToWorldMatrix(node, parentMatrix);
-                if (node.mesh >= 0) 
+                const auto &mesh = model.meshes[node.mesh];
+                for (size_t pIdx = 0; pIdx < mesh.primitives.size(); ++pIdx) 
                 {
-                    const auto &mesh = model.meshes[node.mesh];
-                    for (size_t pIdx = 0; pIdx < mesh.primitives.size(); ++pIdx) 
+                    const auto &primitive = mesh.primitives[pIdx];
+                    const auto positionAttrIdxIt = primitive.attributes.find("POSITION");
+                    if (positionAttrIdxIt == end(primitive.attributes)) 
                     {
-                        const auto &primitive = mesh.primitives[pIdx];
-                        const auto positionAttrIdxIt = primitive.attributes.find("POSITION");
-                        if (positionAttrIdxIt == end(primitive.attributes)) 
-                        {
-                            continue;
-                        }
-                        const auto &positionAccessor = model.accessors[(*positionAttrIdxIt).second];
-                        if (positionAccessor.type != 3) 
-                        {
-                            std::cerr << "Position accessor with type != VEC3, skipping" << std::endl;
-                            continue;
-                        }
+                        continue;
+                    }
+                    const auto &positionAccessor = model.accessors[(*positionAttrIdxIt).second];
+                    if (positionAccessor.type != 3) 
+                    {
+                        std::cerr << "Position accessor with type != VEC3, skipping" << std::endl;
+                        continue;
+                    }
 
-                        const auto &positionBufferView = model.bufferViews[positionAccessor.bufferView];
-                        const auto byteOffset = positionAccessor.byteOffset + positionBufferView.byteOffset;
-                        const auto &positionBuffer = model.buffers[positionBufferView.buffer];
-                        const auto positionByteStride = positionBufferView.byteStride ? positionBufferView.byteStride : 3 * sizeof(float);
+                    const auto &positionBufferView = model.bufferViews[positionAccessor.bufferView];
+                    const auto byteOffset = positionAccessor.byteOffset + positionBufferView.byteOffset;
+                    const auto &positionBuffer = model.buffers[positionBufferView.buffer];
 
-                        if (primitive.indices >= 0) 
-                        {
-                            const auto &indexAccessor = model.accessors[primitive.indices];
-                            const auto &indexBufferView = model.bufferViews[indexAccessor.bufferView];
-                            const auto indexByteOffset = indexAccessor.byteOffset + indexBufferView.byteOffset;
-                            const auto &indexBuffer = model.buffers[indexBufferView.buffer];
-                            auto indexByteStride = indexBufferView.byteStride;
-
-                            switch (indexAccessor.componentType) 
-                            {
-                            default:
-                            std::cerr
-                                << "Primitive index accessor with bad componentType "
-                                << indexAccessor.componentType << ", skipping it."
-                                << std::endl;
-                            continue;
-                            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
-                            indexByteStride =
-                                indexByteStride ? indexByteStride : sizeof(uint8_t);
-                            break;
-                            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
-                            indexByteStride =
-                                indexByteStride ? indexByteStride : sizeof(uint16_t);
-                            break;
-                            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
-                            indexByteStride =
-                                indexByteStride ? indexByteStride : sizeof(uint32_t);
-                            break;
-                            }
-                            for (size_t i = 0; i < indexAccessor.count; ++i) 
-                            {
-                                uint32_t index = 0;
-                                switch (indexAccessor.componentType) 
-                                {
-                                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
-                                    index = *((const uint8_t *)&indexBuffer
-                                                .data[indexByteOffset + indexByteStride * i]);
-                                    break;
-                                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
-                                    index = *((const uint16_t *)&indexBuffer
-                                                .data[indexByteOffset + indexByteStride * i]);
-                                    break;
-                                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
-                                    index = *((const uint32_t *)&indexBuffer
-                                                .data[indexByteOffset + indexByteStride * i]);
-                                    break;
-                                }
-                                const auto &localPosition =
-                                    *((const glm::vec3 *)&positionBuffer
-                                            .data[byteOffset + positionByteStride * index]);
-                                const auto worldPosition =
-                                    glm::vec3(modelMatrix * glm::vec4(localPosition, 1.f));
-                                bboxMin = glm::min(bboxMin, worldPosition);
-                                bboxMax = glm::max(bboxMax, worldPosition);
-                            }
-                        } 
-                        else 
+                    BoundsSource source;
+                    source.modelMatrix = modelMatrix;
+                    source.positions = positionBuffer.data.data() + byteOffset;
+                    source.positionByteStride = positionBufferView.byteStride ? positionBufferView.byteStride : 3 * sizeof(float);
+                    source.indices = nullptr;
+                    source.indexByteStride = 0;
+                    source.indexComponentType = 0;
+                    source.count = positionAccessor.count;
+
+                    if (primitive.indices >= 0) 
+                    {
+                        const auto &indexAccessor = model.accessors[primitive.indices];
+                        const auto &indexBufferView = model.bufferViews[indexAccessor.bufferView];
+                        const auto indexByteOffset = indexAccessor.byteOffset + indexBufferView.byteOffset;
+                        const auto &indexBuffer = model.buffers[indexBufferView.buffer];
+                        auto indexByteStride = indexBufferView.byteStride;
+
+                        switch (indexAccessor.componentType) 
                         {
-                            for (size_t i = 0; i < positionAccessor.count; ++i) 
-                            {
-                                const auto &localPosition = *((const glm::vec3 *)&positionBuffer.data[byteOffset + positionByteStride * i]);
-                                const auto worldPosition = glm::vec3(modelMatrix * glm::vec4(localPosition, 1.f));
-                                bboxMin = glm::min(bboxMin, worldPosition);
-                                bboxMax = glm::max(bboxMax, worldPosition);
-                            }
+                        default:
+                        std::cerr
+                            << "Primitive index accessor with bad componentType "
+                            << indexAccessor.componentType << ", skipping it."
+                            << std::endl;
+                        continue;
+                        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+                        indexByteStride =
+                            indexByteStride ? indexByteStride : sizeof(uint8_t);
+                        break;
+                        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+                        indexByteStride =
+                            indexByteStride ? indexByteStride : sizeof(uint16_t);
+                        break;
+                        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+                        indexByteStride =
+                            indexByteStride ? indexByteStride : sizeof(uint32_t);
+                        break;
                         }
+
+                        source.indices = indexBuffer.data.data() + indexByteOffset;
+                        source.indexByteStride = indexByteStride;
+                        source.indexComponentType = indexAccessor.componentType;
+                        source.count = indexAccessor.count;
                     }
+
+                    sources.emplace_back(source);
+                }
+            }
+
+            for (const auto childNodeIdx : node.children)
+            {
+                collectSources(childNodeIdx, modelMatrix);
+            }
+        };
+
+        for (const auto nodeIdx : model.scenes[model.defaultScene].nodes)
+        {
+            collectSources(nodeIdx, glm::mat4(1));
+        }
+
+        std::vector<BoundsChunk> chunks;
+        for (size_t sourceIdx = 0; sourceIdx < sources.size(); ++sourceIdx)
+        {
+            for (size_t begin = 0; begin < sources[sourceIdx].count; begin += BOUNDS_CHUNK_SIZE)
+            {
+                chunks.push_back({ sourceIdx, begin, std::min(begin + BOUNDS_CHUNK_SIZE, sources[sourceIdx].count) });
+            }
+        }
+
+        jobs::getScheduler().parallelFor(0, chunks.size(), 1, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                computeChunkBounds(sources[chunks[i].sourceIdx], chunks[i]);
+            }
+        });
+
+        for (const BoundsChunk& chunk : chunks)
+        {
+            bboxMin = glm::min(bboxMin, chunk.bboxMin);
+            bboxMax = glm::max(bboxMax, chunk.bboxMax);
+        }
+    }
+
+    std::vector<MeshBounds> computeMeshBounds(const tinygltf::Model &model)
+    {
+        std::vector<MeshBounds> meshBounds(model.meshes.size());
+        for (size_t meshIdx = 0; meshIdx < model.meshes.size(); ++meshIdx)
+        {
+            MeshBounds& bounds = meshBounds[meshIdx];
+            bounds.min = glm::vec3(std::numeric_limits<float>::max());
+            bounds.max = glm::vec3(std::numeric_limits<float>::lowest());
+            bounds.valid = true;
+
+            for (const auto &primitive : model.meshes[meshIdx].primitives)
+            {
+                const auto positionAttrIdxIt = primitive.attributes.find("POSITION");
+                if (positionAttrIdxIt == end(primitive.attributes))
+                {
+                    continue;
                 }
 
-                for (const auto childNodeIdx : node.children)
+                // Required by the glTF spec for POSITION, but not every exporter complies
+                const auto &positionAccessor = model.accessors[(*positionAttrIdxIt).second];
+                if (positionAccessor.minValues.size() != 3 || positionAccessor.maxValues.size() != 3)
                 {
-                    updateBounds(childNodeIdx, modelMatrix);
+                    bounds.valid = false;
+                    break;
                 }
-            };
 
-            for (const auto nodeIdx : model.scenes[model.defaultScene].nodes)
+                bounds.min = glm::min(bounds.min, glm::vec3((float)positionAccessor.minValues[0], (float)positionAccessor.minValues[1], (float)positionAccessor.minValues[2]));
+                bounds.max = glm::max(bounds.max, glm::vec3((float)positionAccessor.maxValues[0], (float)positionAccessor.maxValues[1], (float)positionAccessor.maxValues[2]));
+            }
+
+            if (bounds.min.x > bounds.max.x) // No positions at all
             {
-                updateBounds(nodeIdx, glm::mat4(1));
+                bounds.valid = false;
             }
         }
+        return meshBounds;
     }
 }
\ No newline at end of file
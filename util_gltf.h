@@ -19,10 +19,19 @@ namespace utilgltf
         GLsizei count; // Number of elements in range
     };
 
+    // Local space bounding box of a mesh, from the min and max of its primitives' POSITION accessors
+    struct MeshBounds
+    {
+        glm::vec3 min;
+        glm::vec3 max;
+        bool valid; // False if an accessor lacks min or max, such meshes can not be culled
+    };
+
     bool loadGLTFfile(std::filesystem::path filePath, tinygltf::Model& model);
     std::vector<GLuint> createTextureObjects(const tinygltf::Model& model);
     std::vector<GLuint> createVBOs(const tinygltf::Model& model);
     std::vector<GLuint> createVAOs(const tinygltf::Model &model, const std::vector<GLuint>& VBOs, std::vector<VAOrange>& meshToVertexArrays);
     glm::mat4 getLocalToWorldMatrix(const tinygltf::Node& node, const glm::mat4& parentMatrix);
     void computeSceneBounds(const tinygltf::Model &model, glm::vec3 &bboxMin, glm::vec3 &bboxMax);
+    std::vector<MeshBounds> computeMeshBounds(const tinygltf::Model &model);
 }